@@ -284,6 +284,11 @@ __STATIC_INLINE void init_cycfg_power(void)
 }
 
 
+/* Not generated, keep when regenerating: boot profiler mark, see boot.cpp */
+__WEAK void boot_clocks_ready(void)
+{
+}
+
 void init_cycfg_system(void)
 {
 	/* Set worst case memory wait states (! ultra low power, 150 MHz), will update at the end */
@@ -567,6 +572,7 @@ void init_cycfg_system(void)
 	
 	/* Update System Core Clock values for correct Cy_SysLib_Delay functioning */
 	SystemCoreClockUpdate();
+	boot_clocks_ready();
 
 #if defined (CY_USING_HAL)
 	cyhal_hwmgr_reserve(&srss_0_clock_0_pathmux_0_obj);
@@ -60,6 +60,86 @@
     #include "cy8ckit_028_tft_config.h"
 #endif
 
+/* Port-wide register writes for the data bus and NWR, 0 uses the HAL only */
+#ifndef CY_TFT_FAST_IO
+    #define CY_TFT_FAST_IO          (1)
+#endif
+
+/* The data pins must not be spread over more ports than this */
+#define CY_TFT_MAX_PORTS            (4u)
+
+/*
+ * DataWire DMA transport for repeated pixels, 0 writes everything with the CPU.
+ *
+ * The write strobe can not come from SMART I/O (only on P8/P9, NWR is on
+ * P12) nor from UDB (no UDB configuration flow for this target), so the
+ * DMA writes the GPIO registers itself: for every bus byte one OUT_INV word
+ * per port from the lowest to the highest of the data and NWR ports (0 for
+ * ports without change, a no-op) with NWR falling, then the same with only
+ * NWR rising. The words of a byte only depend on the XOR of the bytes
+ * before and after, so streams repeating a 2 byte pattern (emWin fills)
+ * use one small staging buffer and the CPU only sets up descriptors.
+ */
+#ifndef CY_TFT_DMA
+    #define CY_TFT_DMA              (0)
+#endif
+
+#if CY_TFT_DMA
+    #if !CY_TFT_FAST_IO
+        #error CY_TFT_DMA needs CY_TFT_FAST_IO
+    #endif
+
+    /* The channel is reserved with the HAL, taken by another user the CPU writes */
+    #ifndef CY_TFT_DMA_HW
+        #define CY_TFT_DMA_HW           (DW1)
+        #define CY_TFT_DMA_BLOCK        (1u)
+        #define CY_TFT_DMA_CHANNEL      (0u)
+        #define CY_TFT_DMA_TRIGGER      (TRIG1_OUT_CPUSS_DW1_TR_IN0)
+        #define CY_TFT_DMA_IRQ          (cpuss_interrupts_dw1_0_IRQn)
+    #endif
+
+    /* Shorter streams are not worth the descriptor setup */
+    #define CY_TFT_DMA_MIN_BYTES        (64)
+    /* Bus bytes per descriptor, at most 128 (Y count of 256 phases) */
+    #define CY_TFT_DMA_BURST            (32u)
+    /* Descriptors chained per trigger */
+    #define CY_TFT_DMA_DESCRIPTORS      (16u)
+    /* Ports from the lowest to the highest bus port */
+    #define CY_TFT_DMA_MAX_SPAN         (8u)
+#endif
+
+
+#if CY_TFT_FAST_IO
+/*
+ * For every byte value, the bits of each data port that are high. A byte
+ * is written with one OUT_INV write per port, of the bits that differ from
+ * the byte on the bus, so it is not even written for ports without change.
+ */
+static GPIO_PRT_Type *tft_data_port[CY_TFT_MAX_PORTS];
+static uint8_t tft_data_lut[256][CY_TFT_MAX_PORTS];
+static uint8_t tft_num_ports = 0u;
+static uint8_t tft_bus_byte = 0u;
+
+static GPIO_PRT_Type *tft_nwr_port;
+static uint32_t tft_nwr_mask;
+static GPIO_PRT_Type *tft_dc_port;
+static uint32_t tft_dc_mask;
+
+static bool tft_fast_io = false;
+#endif
+
+#if CY_TFT_DMA
+static cy_stc_dma_descriptor_t tft_dma_descr[CY_TFT_DMA_DESCRIPTORS];
+static uint32_t tft_dma_stage[CY_TFT_DMA_BURST * 2u * CY_TFT_DMA_MAX_SPAN];
+static int16_t tft_dma_stage_key = -1;
+static GPIO_PRT_Type *tft_dma_first_port;
+static uint32_t tft_dma_span;
+static uint32_t tft_dma_stride;
+static volatile bool tft_dma_busy = false;
+static bool tft_dma = false;
+static const cyhal_resource_inst_t tft_dma_rsc = { CYHAL_RSC_DW, CY_TFT_DMA_BLOCK, CY_TFT_DMA_CHANNEL };
+#endif
+
 
 
 /*******************************************************************************
@@ -112,6 +192,373 @@ __STATIC_INLINE void write_data(uint8_t data)
     cyhal_gpio_write(CY_TFT_NWR, 1u);
 }
 
+#if CY_TFT_FAST_IO
+/*******************************************************************************
+ * Builds the per byte lookup table from the pin assignment, returns false if
+ * the data pins are spread over too many ports.
+ *******************************************************************************/
+static bool fast_io_init(void)
+{
+    static const cyhal_gpio_t data_pins[8] = {
+        CY_TFT_DB8, CY_TFT_DB9, CY_TFT_DB10, CY_TFT_DB11,
+        CY_TFT_DB12, CY_TFT_DB13, CY_TFT_DB14, CY_TFT_DB15
+    };
+    uint8_t port_of_bit[8];
+
+    tft_num_ports = 0u;
+
+    for(uint8_t bit = 0u; bit < 8u; bit++)
+    {
+        GPIO_PRT_Type *port = Cy_GPIO_PortToAddr(CYHAL_GET_PORT(data_pins[bit]));
+        uint8_t i;
+
+        for(i = 0u; i < tft_num_ports && tft_data_port[i] != port; i++)
+        {
+        }
+
+        if(i == tft_num_ports)
+        {
+            if(tft_num_ports == CY_TFT_MAX_PORTS)
+            {
+                return false;
+            }
+            tft_data_port[tft_num_ports++] = port;
+        }
+        port_of_bit[bit] = i;
+    }
+
+    for(uint32_t value = 0u; value < 256u; value++)
+    {
+        for(uint8_t i = 0u; i < CY_TFT_MAX_PORTS; i++)
+        {
+            tft_data_lut[value][i] = 0u;
+        }
+
+        for(uint8_t bit = 0u; bit < 8u; bit++)
+        {
+            if(value & (1u << bit))
+            {
+                tft_data_lut[value][port_of_bit[bit]] |= 1u << CYHAL_GET_PIN(data_pins[bit]);
+            }
+        }
+    }
+
+    tft_nwr_port = Cy_GPIO_PortToAddr(CYHAL_GET_PORT(CY_TFT_NWR));
+    tft_nwr_mask = 1u << CYHAL_GET_PIN(CY_TFT_NWR);
+    tft_dc_port = Cy_GPIO_PortToAddr(CYHAL_GET_PORT(CY_TFT_DC));
+    tft_dc_mask = 1u << CYHAL_GET_PIN(CY_TFT_DC);
+
+    /* start from a known byte on the bus, no strobe so the display ignores it */
+    for(uint8_t i = 0u; i < tft_num_ports; i++)
+    {
+        tft_data_port[i]->OUT_CLR = tft_data_lut[0xFFu][i];
+    }
+    tft_bus_byte = 0u;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Writes one byte with one register write per changed data port and two for
+ * the NWR strobe.
+ *******************************************************************************/
+__STATIC_INLINE void fast_write_data(uint8_t data)
+{
+    const uint8_t *next = tft_data_lut[data];
+    const uint8_t *prev = tft_data_lut[tft_bus_byte];
+
+    for(uint8_t i = 0u; i < tft_num_ports; i++)
+    {
+        uint8_t diff = next[i] ^ prev[i];
+
+        if(diff)
+        {
+            tft_data_port[i]->OUT_INV = diff;
+        }
+    }
+    tft_bus_byte = data;
+
+    tft_nwr_port->OUT_CLR = tft_nwr_mask;
+    tft_nwr_port->OUT_SET = tft_nwr_mask;
+}
+
+__STATIC_INLINE void fast_write_stream(const uint8_t data[], int num)
+{
+    int i = 0;
+
+    for(; i + 4 <= num; i += 4)
+    {
+        fast_write_data(data[i]);
+        fast_write_data(data[i + 1]);
+        fast_write_data(data[i + 2]);
+        fast_write_data(data[i + 3]);
+    }
+
+    for(; i < num; i++)
+    {
+        fast_write_data(data[i]);
+    }
+}
+#endif
+
+#if CY_TFT_DMA
+/*******************************************************************************
+ * Called to wait for the end of a DMA stream and from the DMA interrupt at
+ * the end. The defaults spin, an RTOS application overrides both to block.
+ *******************************************************************************/
+__WEAK void cy_tft_dma_wait(void)
+{
+    while(tft_dma_busy)
+    {
+    }
+}
+
+__WEAK void cy_tft_dma_done(void)
+{
+}
+
+static void dma_isr(void)
+{
+    Cy_DMA_Channel_ClearInterrupt(CY_TFT_DMA_HW, CY_TFT_DMA_CHANNEL);
+    tft_dma_busy = false;
+    cy_tft_dma_done();
+}
+
+/*******************************************************************************
+ * Reserves the channel, finds the port span for the DMA and hooks the
+ * interrupt, returns false if the channel is in use or the bus ports are too
+ * far apart.
+ *******************************************************************************/
+static bool dma_init(void)
+{
+    uint32_t first = CYHAL_GET_PORT(CY_TFT_NWR);
+    uint32_t last = first;
+
+    if(CY_RSLT_SUCCESS != cyhal_hwmgr_reserve(&tft_dma_rsc))
+    {
+        return false;
+    }
+
+    for(uint8_t i = 0u; i < tft_num_ports; i++)
+    {
+        for(uint32_t port = 0u; port < 16u; port++)
+        {
+            if(Cy_GPIO_PortToAddr(port) == tft_data_port[i])
+            {
+                first = (port < first) ? port : first;
+                last = (port > last) ? port : last;
+            }
+        }
+    }
+
+    if(last - first + 1u > CY_TFT_DMA_MAX_SPAN)
+    {
+        cyhal_hwmgr_free(&tft_dma_rsc);
+        return false;
+    }
+
+    tft_dma_first_port = Cy_GPIO_PortToAddr(first);
+    tft_dma_span = last - first + 1u;
+    tft_dma_stride = ((uint32_t)Cy_GPIO_PortToAddr(first + 1u) - (uint32_t)tft_dma_first_port) / sizeof(uint32_t);
+    tft_dma_stage_key = -1;
+
+    const cy_stc_sysint_t irq_cfg = { .intrSrc = CY_TFT_DMA_IRQ, .intrPriority = 3u };
+
+    Cy_DMA_Enable(CY_TFT_DMA_HW);
+    Cy_DMA_Channel_SetInterruptMask(CY_TFT_DMA_HW, CY_TFT_DMA_CHANNEL, CY_DMA_INTR_MASK);
+    Cy_SysInt_Init(&irq_cfg, dma_isr);
+    NVIC_EnableIRQ(irq_cfg.intrSrc);
+
+    return true;
+}
+
+/* Index of a port in the span */
+__STATIC_INLINE uint32_t dma_port_index(GPIO_PRT_Type *port)
+{
+    return ((uint32_t)port - (uint32_t)tft_dma_first_port) / (tft_dma_stride * sizeof(uint32_t));
+}
+
+/*******************************************************************************
+ * Staging of CY_TFT_DMA_BURST bytes for bytes alternating with XOR key.
+ *******************************************************************************/
+static void dma_stage(uint8_t key)
+{
+    uint32_t nwr = dma_port_index(tft_nwr_port);
+    uint32_t fall[CY_TFT_DMA_MAX_SPAN] = { 0u };
+    uint32_t rise[CY_TFT_DMA_MAX_SPAN] = { 0u };
+
+    for(uint8_t i = 0u; i < tft_num_ports; i++)
+    {
+        fall[dma_port_index(tft_data_port[i])] = tft_data_lut[key][i];
+    }
+    fall[nwr] |= tft_nwr_mask;
+    rise[nwr] = tft_nwr_mask;
+
+    for(uint32_t b = 0u; b < CY_TFT_DMA_BURST; b++)
+    {
+        for(uint32_t port = 0u; port < tft_dma_span; port++)
+        {
+            tft_dma_stage[(2u * b) * tft_dma_span + port] = fall[port];
+            tft_dma_stage[(2u * b + 1u) * tft_dma_span + port] = rise[port];
+        }
+    }
+
+    tft_dma_stage_key = key;
+}
+
+/*******************************************************************************
+ * Writes num bytes alternating between the byte after the one on the bus and
+ * the one on the bus, with DC already set.
+ *******************************************************************************/
+static void dma_write_repeat(uint8_t next, int num)
+{
+    uint8_t key = next ^ tft_bus_byte;
+
+    if(tft_dma_stage_key != key)
+    {
+        dma_stage(key);
+    }
+
+    if(num & 1)
+    {
+        tft_bus_byte = next;
+    }
+
+    while(num > 0)
+    {
+        uint32_t n;
+
+        for(n = 0u; n < CY_TFT_DMA_DESCRIPTORS && num > 0; n++)
+        {
+            uint32_t bytes = ((uint32_t)num < CY_TFT_DMA_BURST) ? (uint32_t)num : CY_TFT_DMA_BURST;
+            bool last = (n + 1u == CY_TFT_DMA_DESCRIPTORS) || ((uint32_t)num == bytes);
+            cy_stc_dma_descriptor_config_t cfg =
+            {
+                .retrigger       = CY_DMA_RETRIG_IM,
+                .interruptType   = CY_DMA_DESCR_CHAIN,
+                .triggerOutType  = CY_DMA_DESCR_CHAIN,
+                .channelState    = last ? CY_DMA_CHANNEL_DISABLED : CY_DMA_CHANNEL_ENABLED,
+                .triggerInType   = CY_DMA_DESCR_CHAIN,
+                .dataSize        = CY_DMA_WORD,
+                .srcTransferSize = CY_DMA_TRANSFER_SIZE_DATA,
+                .dstTransferSize = CY_DMA_TRANSFER_SIZE_DATA,
+                .descriptorType  = CY_DMA_2D_TRANSFER,
+                .srcAddress      = tft_dma_stage,
+                .dstAddress      = (void *)&tft_dma_first_port->OUT_INV,
+                .srcXincrement   = 1,
+                .dstXincrement   = (int32_t)tft_dma_stride,
+                .xCount          = tft_dma_span,
+                .srcYincrement   = (int32_t)tft_dma_span,
+                .dstYincrement   = 0,
+                .yCount          = 2u * bytes,
+                .nextDescriptor  = last ? NULL : &tft_dma_descr[n + 1u]
+            };
+
+            Cy_DMA_Descriptor_Init(&tft_dma_descr[n], &cfg);
+            num -= (int)bytes;
+        }
+
+        const cy_stc_dma_channel_config_t channel_cfg =
+        {
+            .descriptor  = &tft_dma_descr[0],
+            .preemptable = false,
+            .priority    = 3u,
+            .enable      = false,
+            .bufferable  = false
+        };
+
+        Cy_DMA_Channel_Init(CY_TFT_DMA_HW, CY_TFT_DMA_CHANNEL, &channel_cfg);
+        tft_dma_busy = true;
+        __DMB();
+        Cy_DMA_Channel_Enable(CY_TFT_DMA_HW, CY_TFT_DMA_CHANNEL);
+        Cy_TrigMux_SwTrigger(CY_TFT_DMA_TRIGGER, CY_TRIGGER_TWO_CYCLES);
+
+        cy_tft_dma_wait();
+    }
+}
+
+/*******************************************************************************
+ * True if the stream repeats its first 2 bytes.
+ *******************************************************************************/
+static bool is_repeated_pair(const uint8_t data[], int num)
+{
+    for(int i = 2; i < num; i++)
+    {
+        if(data[i] != data[i - 2])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+#if CY_TFT_FAST_IO
+/*******************************************************************************
+ * Writes the byte pair count times. The ports whose pins differ between the
+ * two bytes are collected once, then every byte is one OUT_INV write per such
+ * port and the strobe, a fill of a single byte value only strobes.
+ *******************************************************************************/
+static void fast_write_repeat(uint8_t first, uint8_t second, uint32_t count)
+{
+    volatile uint32_t *inv[CY_TFT_MAX_PORTS];
+    uint32_t diff[CY_TFT_MAX_PORTS];
+    volatile uint32_t *nwr_clr = &tft_nwr_port->OUT_CLR;
+    volatile uint32_t *nwr_set = &tft_nwr_port->OUT_SET;
+    uint32_t nwr = tft_nwr_mask;
+    uint8_t num = 0u;
+
+    fast_write_data(first);
+    fast_write_data(second);
+    count--;
+
+    for(uint8_t i = 0u; i < tft_num_ports; i++)
+    {
+        uint8_t d = tft_data_lut[first][i] ^ tft_data_lut[second][i];
+
+        if(d)
+        {
+            inv[num] = &tft_data_port[i]->OUT_INV;
+            diff[num++] = d;
+        }
+    }
+
+    if(num == 0u)
+    {
+        for(count *= 2u; count >= 4u; count -= 4u)
+        {
+            *nwr_clr = nwr; *nwr_set = nwr;
+            *nwr_clr = nwr; *nwr_set = nwr;
+            *nwr_clr = nwr; *nwr_set = nwr;
+            *nwr_clr = nwr; *nwr_set = nwr;
+        }
+        for(; count > 0u; count--)
+        {
+            *nwr_clr = nwr; *nwr_set = nwr;
+        }
+    }
+    else if(num == 1u)
+    {
+        for(; count > 0u; count--)
+        {
+            *inv[0] = diff[0]; *nwr_clr = nwr; *nwr_set = nwr;
+            *inv[0] = diff[0]; *nwr_clr = nwr; *nwr_set = nwr;
+        }
+    }
+    else
+    {
+        for(count *= 2u; count > 0u; count--)
+        {
+            for(uint8_t i = 0u; i < num; i++)
+            {
+                *inv[i] = diff[i];
+            }
+            *nwr_clr = nwr; *nwr_set = nwr;
+        }
+    }
+}
+#endif
+
 /*******************************************************************************
  * Reads one byte of data from the software i8080 interface.
  *******************************************************************************/
@@ -161,6 +608,14 @@ cy_rslt_t cy_tft_io_init(void)
         rslt = cyhal_gpio_init(CY_TFT_RST, CYHAL_GPIO_DIR_OUTPUT, CYHAL_GPIO_DRIVE_STRONG, 1u);
     if (CY_RSLT_SUCCESS == rslt)
         rslt = cyhal_gpio_init(CY_TFT_NRD, CYHAL_GPIO_DIR_OUTPUT, CYHAL_GPIO_DRIVE_STRONG, 1u);
+#if CY_TFT_FAST_IO
+    if (CY_RSLT_SUCCESS == rslt)
+        tft_fast_io = fast_io_init();
+#endif
+#if CY_TFT_DMA
+    if (tft_fast_io)
+        tft_dma = dma_init();
+#endif
     return rslt;
 }
 
@@ -171,12 +626,28 @@ void cy_tft_write_reset_pin(uint8_t value)
 
 void cy_tft_write_command(uint8_t data)
 {
+#if CY_TFT_FAST_IO
+    if(tft_fast_io)
+    {
+        tft_dc_port->OUT_CLR = tft_dc_mask;
+        fast_write_data(data);
+        return;
+    }
+#endif
     cyhal_gpio_write(CY_TFT_DC, 0u);
     write_data(data);
 }
 
 void cy_tft_write_data(uint8_t data)
 {
+#if CY_TFT_FAST_IO
+    if(tft_fast_io)
+    {
+        tft_dc_port->OUT_SET = tft_dc_mask;
+        fast_write_data(data);
+        return;
+    }
+#endif
     cyhal_gpio_write(CY_TFT_DC, 1u);
     write_data(data);
 }
@@ -185,6 +656,15 @@ void cy_tft_write_command_stream(uint8_t data[], int num)
 {
     int i = 0;
 
+#if CY_TFT_FAST_IO
+    if(tft_fast_io)
+    {
+        tft_dc_port->OUT_CLR = tft_dc_mask;
+        fast_write_stream(data, num);
+        return;
+    }
+#endif
+
     cyhal_gpio_write(CY_TFT_DC, 0u);
 
     for(i = 0; i < num; i++)
@@ -197,6 +677,24 @@ void cy_tft_write_data_stream(uint8_t data[], int num)
 {
     int i = 0;
 
+#if CY_TFT_FAST_IO
+    if(tft_fast_io)
+    {
+        tft_dc_port->OUT_SET = tft_dc_mask;
+#if CY_TFT_DMA
+        if(tft_dma && num >= CY_TFT_DMA_MIN_BYTES && is_repeated_pair(data, num))
+        {
+            /* the first byte pair goes by CPU, then the bus alternates between them */
+            fast_write_stream(data, 2);
+            dma_write_repeat(data[0], num - 2);
+            return;
+        }
+#endif
+        fast_write_stream(data, num);
+        return;
+    }
+#endif
+
     cyhal_gpio_write(CY_TFT_DC, 1u);
 
     for(i = 0; i < num; i++)
@@ -205,6 +703,83 @@ void cy_tft_write_data_stream(uint8_t data[], int num)
     }
 }
 
+void cy_tft_write_data_repeat(uint8_t first, uint8_t second, uint32_t count)
+{
+    if(count == 0u)
+    {
+        return;
+    }
+
+#if CY_TFT_FAST_IO
+    if(tft_fast_io)
+    {
+        tft_dc_port->OUT_SET = tft_dc_mask;
+#if CY_TFT_DMA
+        if(tft_dma && 2u * count >= CY_TFT_DMA_MIN_BYTES)
+        {
+            fast_write_data(first);
+            fast_write_data(second);
+            dma_write_repeat(first, (int)(2u * count - 2u));
+            return;
+        }
+#endif
+        fast_write_repeat(first, second, count);
+        return;
+    }
+#endif
+
+    cyhal_gpio_write(CY_TFT_DC, 1u);
+
+    for(; count > 0u; count--)
+    {
+        write_data(first);
+        write_data(second);
+    }
+}
+
+bool cy_tft_set_fast_io(bool enable)
+{
+#if CY_TFT_FAST_IO
+    if(enable && !tft_fast_io)
+    {
+        /* the HAL path does not track the bus byte */
+        tft_fast_io = fast_io_init();
+    }
+    else if(!enable)
+    {
+        tft_fast_io = false;
+#if CY_TFT_DMA
+        tft_dma = false;
+#endif
+    }
+    return tft_fast_io;
+#else
+    (void)enable;
+    return false;
+#endif
+}
+
+bool cy_tft_set_dma(bool enable)
+{
+#if CY_TFT_DMA
+    if(enable && !tft_dma && tft_fast_io)
+    {
+        tft_dma = dma_init();
+    }
+    else if(!enable && tft_dma)
+    {
+        /* streams end before the write returns, the channel is idle */
+        NVIC_DisableIRQ(CY_TFT_DMA_IRQ);
+        cyhal_hwmgr_free(&tft_dma_rsc);
+        tft_dma = false;
+    }
+    return tft_dma;
+#else
+    (void)enable;
+    return false;
+#endif
+}
+
 uint8_t cy_tft_read_data(void)
 {
     uint8_t data;
@@ -0,0 +1,254 @@
+/*
+ * applog.cpp
+ *
+ *  Deferred binary logging, see applog.h
+ *
+ *      Author: sc lee
+ *
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#include "applog.h"
+
+#include "mbed.h"
+#include "mbed_atomic.h"
+#include "us_ticker_api.h"
+#include "perf.h"
+#include "console.h"
+
+#include <string.h>
+
+
+#define APPLOG_RING_MASK                        (APPLOG_RING_SIZE - 1u)
+
+#if (APPLOG_RING_SIZE & APPLOG_RING_MASK) != 0
+#error APPLOG_RING_SIZE must be power of 2
+#endif
+
+/* "log bench": calls per variant, in bursts leaving the ring to the others */
+#define APPLOG_BENCH_CALLS                      (256u)
+#define APPLOG_BENCH_BURST                      (8u)
+
+/* Producer cost per call the logger is made for */
+#define APPLOG_BENCH_BUDGET_NS                  (1000u)
+
+
+/*
+ * One record is 32 bytes. commit is written last with the reservation
+ * index + 1, so the drain thread knows when a reserved slot is complete.
+ */
+typedef struct {
+	volatile uint32_t commit;
+	uint32_t timestamp;
+	uint16_t id;
+	uint8_t level;
+	uint8_t nargs;
+	uint32_t args[APPLOG_MAX_ARGS];
+} applog_record_t;
+
+
+static applog_record_t applog_ring[APPLOG_RING_SIZE];
+static volatile uint32_t applog_head = 0;
+static volatile uint32_t applog_tail = 0;
+static volatile uint32_t applog_drop_count = 0;
+static volatile uint32_t applog_drain_period = APPLOG_DRAIN_PERIOD_MS;
+
+Thread applog_thread(osPriorityLow, 1024, NULL, "applog_thread");
+
+
+
+/*
+ * Reserve a slot, multiple producers race with compare and swap on the
+ * head index. Returns NULL when the ring is full.
+ */
+static applog_record_t *applog_reserve(uint32_t *index)
+{
+	uint32_t head = core_util_atomic_load_u32(&applog_head);
+
+	do {
+		if (head - core_util_atomic_load_u32(&applog_tail) >= APPLOG_RING_SIZE) {
+			core_util_atomic_incr_u32(&applog_drop_count, 1);
+			return NULL;
+		}
+	} while (!core_util_atomic_cas_u32(&applog_head, &head, head + 1));
+
+	*index = head;
+	return &applog_ring[head & APPLOG_RING_MASK];
+}
+
+static void applog_commit(applog_record_t *record, uint32_t index)
+{
+	core_util_atomic_store_u32(&record->commit, index + 1);
+}
+
+
+void applog_write(uint8_t level, uint16_t id, uint8_t nargs, const uint32_t *args)
+{
+	uint32_t index;
+	applog_record_t *record = applog_reserve(&index);
+
+	if (!record)
+		return;
+
+	record->timestamp = us_ticker_read();
+	record->id = id;
+	record->level = level;
+	record->nargs = nargs;
+
+	for (uint8_t i = 0; i < nargs; i++)
+		record->args[i] = args[i];
+
+	applog_commit(record, index);
+}
+
+void applog_write_str(uint8_t level, uint16_t id, const char *str)
+{
+	uint32_t index;
+	applog_record_t *record = applog_reserve(&index);
+
+	if (!record)
+		return;
+
+	record->timestamp = us_ticker_read();
+	record->id = id;
+	record->level = level;
+	record->nargs = APPLOG_MAX_ARGS | APPLOG_FLAG_STRING;
+
+	char *dst = (char *)record->args;
+	size_t len = str ? strnlen(str, sizeof(record->args) - 1) : 0;
+	memcpy(dst, str, len);
+	dst[len] = '\0';
+
+	applog_commit(record, index);
+}
+
+uint32_t applog_dropped(void)
+{
+	return core_util_atomic_load_u32(&applog_drop_count);
+}
+
+
+/*
+ * Print committed records as
+ *   @L <timestamp> <level> <id> <nargs|flags> <arg0> ... <argN>
+ * all fields in hex. Stops at the first reserved but uncommitted slot.
+ */
+static void applog_drain(void)
+{
+	uint32_t tail = applog_tail;
+
+	while (tail != core_util_atomic_load_u32(&applog_head)) {
+		applog_record_t *record = &applog_ring[tail & APPLOG_RING_MASK];
+
+		if (core_util_atomic_load_u32(&record->commit) != tail + 1)
+			break;
+
+		uint8_t nwords = record->nargs & ~APPLOG_FLAG_STRING;
+
+		/* recorded like any other message, but only to be timed */
+		if (record->id != LOG_APPLOG_BENCH && record->id != LOG_APPLOG_BENCH_STR) {
+			printf("@L %lx %x %x %x", record->timestamp, record->level, record->id, record->nargs);
+			for (uint8_t i = 0; i < nwords; i++)
+				printf(" %lx", record->args[i]);
+			printf("\n");
+		}
+
+		tail++;
+		core_util_atomic_store_u32(&applog_tail, tail);
+	}
+}
+
+static void applog_drain_thread(void)
+{
+	uint32_t reported_drop = 0;
+
+	while (true) {
+		applog_drain();
+
+		uint32_t dropped = applog_dropped();
+		if (dropped != reported_drop) {
+			APPLOG_WARN(LOG_APPLOG_DROPPED, dropped - reported_drop);
+			reported_drop = dropped;
+		}
+
+		ThisThread::sleep_for(applog_drain_period);
+	}
+}
+
+void applog_set_drain_period(uint32_t period_ms)
+{
+	applog_drain_period = period_ms;
+}
+
+
+/*
+ * "log bench": cycles of the producer side, what an APPLOG_*() call at an
+ * enabled level costs its caller. The "timer" line is the cost of reading
+ * the cycle counter alone, included in the others.
+ */
+#define APPLOG_BENCH_RUN(name, call) do { \
+	perf_stat_t stat; \
+	perf_stat_reset(&stat); \
+	for (uint32_t n = 0; n < APPLOG_BENCH_CALLS; n++) { \
+		uint32_t start = perf_cycles(); \
+		call; \
+		perf_stat_add(&stat, perf_cycles() - start); \
+		if (n % APPLOG_BENCH_BURST == APPLOG_BENCH_BURST - 1) \
+			applog_bench_wait(); \
+	} \
+	applog_bench_print(name, &stat); \
+} while (0)
+
+static void applog_bench_wait(void)
+{
+	while (core_util_atomic_load_u32(&applog_head) != core_util_atomic_load_u32(&applog_tail))
+		ThisThread::sleep_for(APPLOG_DRAIN_PERIOD_MS);
+}
+
+static void applog_bench_print(const char *name, const perf_stat_t *stat)
+{
+	uint32_t mhz = SystemCoreClock / 1000000u;
+	uint32_t avg = (uint32_t)(stat->sum / stat->count);
+	uint32_t avg_ns = avg * 1000u / mhz;
+
+	printf("%-7s avg: %lu max: %lu cycles, avg %lu ns%s\n", name, avg, stat->max, avg_ns,
+			avg_ns > APPLOG_BENCH_BUDGET_NS ? ", over budget" : "");
+}
+
+static void applog_bench(void)
+{
+	uint32_t dropped = applog_dropped();
+
+	printf("%lu calls per line at %lu MHz, budget %u ns\n", APPLOG_BENCH_CALLS,
+			SystemCoreClock / 1000000u, APPLOG_BENCH_BUDGET_NS);
+
+	applog_bench_wait();
+	APPLOG_BENCH_RUN("timer", (void)0);
+	APPLOG_BENCH_RUN("0 args", applog(APPLOG_LEVEL_DEBUG, LOG_APPLOG_BENCH));
+	APPLOG_BENCH_RUN("1 arg", applog(APPLOG_LEVEL_DEBUG, LOG_APPLOG_BENCH, n));
+	APPLOG_BENCH_RUN("5 args", applog(APPLOG_LEVEL_DEBUG, LOG_APPLOG_BENCH, n, n, n, n, n));
+	APPLOG_BENCH_RUN("string", applog(APPLOG_LEVEL_DEBUG, LOG_APPLOG_BENCH_STR, "bench string"));
+
+	if (applog_dropped() != dropped)
+		printf("dropped meanwhile: %lu\n", applog_dropped() - dropped);
+}
+
+static void applog_cmd(int argc, char *argv[])
+{
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		applog_bench();
+		return;
+	}
+
+	printf("recorded: %lu drained: %lu dropped: %lu, drain period %lu ms\n",
+			core_util_atomic_load_u32(&applog_head), core_util_atomic_load_u32(&applog_tail),
+			applog_dropped(), applog_drain_period);
+}
+
+
+void applog_init(void)
+{
+	perf_init();
+	console_register("log", "stat|bench, deferred logger and its cost per call", applog_cmd);
+	applog_thread.start(applog_drain_thread);
+}
@@ -0,0 +1,137 @@
+/*
+ * applog.h
+ *
+ *  Deferred binary logging
+ *
+ *  The producer only stores the message ID, a timestamp and the raw
+ *  arguments into a lock-free RAM ring, which is safe to call from any
+ *  thread or interrupt. A low priority thread drains the ring to the serial
+ *  port as one "@L" line per record, tools/applog_decode.py turns those
+ *  lines back into text using the format strings of applog_msgs.h.
+ *
+ *  Messages above APPLOG_LEVEL are removed at compile time.
+ *
+ *  A call is meant to cost its caller under 1 us, "log bench" measures it
+ *  on target.
+ *
+ *      Author: sc lee
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef APPLOG_H_
+#define APPLOG_H_
+
+#include <stdint.h>
+
+#define APPLOG_LEVEL_NONE                       (0)
+#define APPLOG_LEVEL_ERROR                      (1)
+#define APPLOG_LEVEL_WARN                       (2)
+#define APPLOG_LEVEL_INFO                       (3)
+#define APPLOG_LEVEL_DEBUG                      (4)
+
+/* Highest level compiled in, override with a macro in mbed_app.json */
+#ifndef APPLOG_LEVEL
+#define APPLOG_LEVEL                            APPLOG_LEVEL_INFO
+#endif
+
+/* Number of records of the ring, must be power of 2 */
+#ifndef APPLOG_RING_SIZE
+#define APPLOG_RING_SIZE                        (64u)
+#endif
+
+/* Period of the drain thread */
+#ifndef APPLOG_DRAIN_PERIOD_MS
+#define APPLOG_DRAIN_PERIOD_MS                  (20u)
+#endif
+
+#define APPLOG_MAX_ARGS                         (5u)
+
+/* Record flag, the argument words hold a NUL terminated string */
+#define APPLOG_FLAG_STRING                      (0x80u)
+
+
+enum applog_msg_id {
+#define APPLOG_MSG(id, fmt) id,
+#include "applog_msgs.h"
+#undef APPLOG_MSG
+    APPLOG_MSG_COUNT
+};
+
+
+/**
+ *
+ * Start the drain thread
+ *
+ */
+void applog_init(void);
+
+/**
+ *
+ * Record a message with integer arguments
+ *
+ * @param level the log level
+ * @param id the message ID of applog_msgs.h
+ * @param nargs the number of words in args
+ * @param args the raw arguments
+ *
+ */
+void applog_write(uint8_t level, uint16_t id, uint8_t nargs, const uint32_t *args);
+
+/**
+ *
+ * Record a message with a single string argument, the string is copied
+ * and truncated to APPLOG_MAX_ARGS * 4 - 1 characters.
+ *
+ * @param level the log level
+ * @param id the message ID of applog_msgs.h
+ * @param str the string argument
+ *
+ */
+void applog_write_str(uint8_t level, uint16_t id, const char *str);
+
+/**
+ *
+ * Get number of records dropped because the ring was full
+ *
+ */
+uint32_t applog_dropped(void);
+
+/**
+ *
+ * Change the period of the drain thread, longer periods let the device
+ * stay in deep sleep longer
+ *
+ * @param period_ms the new period
+ *
+ */
+void applog_set_drain_period(uint32_t period_ms);
+
+
+template <typename... ArgTs>
+inline void applog(uint8_t level, uint16_t id, ArgTs... args)
+{
+    static_assert(sizeof...(args) <= APPLOG_MAX_ARGS, "too many log arguments");
+
+    const uint32_t words[] = { (uint32_t)args..., 0u };
+    applog_write(level, id, sizeof...(args), words);
+}
+
+inline void applog(uint8_t level, uint16_t id, const char *str)
+{
+    applog_write_str(level, id, str);
+}
+
+
+/*
+ * The level check is a constant expression, so disabled levels generate no
+ * code while the arguments are still type checked.
+ */
+#define APPLOG_AT(level, ...)                   do { if ((level) <= APPLOG_LEVEL) applog((level), __VA_ARGS__); } while (0)
+
+#define APPLOG_ERROR(...)                       APPLOG_AT(APPLOG_LEVEL_ERROR, __VA_ARGS__)
+#define APPLOG_WARN(...)                        APPLOG_AT(APPLOG_LEVEL_WARN, __VA_ARGS__)
+#define APPLOG_INFO(...)                        APPLOG_AT(APPLOG_LEVEL_INFO, __VA_ARGS__)
+#define APPLOG_DEBUG(...)                       APPLOG_AT(APPLOG_LEVEL_DEBUG, __VA_ARGS__)
+
+
+#endif /* APPLOG_H_ */
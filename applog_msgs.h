@@ -0,0 +1,44 @@
+/*
+ * applog_msgs.h
+ *
+ *  Format string table of the deferred logger.
+ *
+ *  Only the message ID and the raw arguments are recorded on target, the
+ *  format strings below are used by tools/applog_decode.py to turn the
+ *  drained records back into text. IDs are assigned in order of appearance,
+ *  so append new messages at the end to keep old captures decodable.
+ *
+ *  A message takes either up to APPLOG_MAX_ARGS integer arguments or a
+ *  single string argument (%s).
+ *
+ *      Author: sc lee
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+/* No include guard, this file is expanded with different APPLOG_MSG() definitions */
+
+APPLOG_MSG( LOG_CAPSENSE_BUTTON,        "Button_%lu status: %lu" )
+APPLOG_MSG( LOG_CAPSENSE_SLIDER,        "Slider position: %lu" )
+APPLOG_MSG( LOG_AWS_CONFIG_ERROR,       "Please configure SSL_CLIENTKEY_PEM, SSL_CLIENTCERT_PEM and SSL_CA_PEM in aws_config.h file" )
+APPLOG_MSG( LOG_AWS_CONNECT_FAILED,     "connection to AWS endpoint failed (0x%lx)" )
+APPLOG_MSG( LOG_AWS_CONNECTED,          "Connected to AWS endpoint" )
+APPLOG_MSG( LOG_AWS_PUBLISH_FAILED,     "publish to topic failed (0x%lx)" )
+APPLOG_MSG( LOG_AWS_PUBLISHED,          "Published to topic, %lu bytes" )
+APPLOG_MSG( LOG_AWS_NO_MESSAGE,         "no message to send..." )
+APPLOG_MSG( LOG_AWS_SEND,               "sending %lu keys, %lu bytes" )
+APPLOG_MSG( LOG_NET_NO_INTERFACE,       "ERROR: No WiFiInterface found." )
+APPLOG_MSG( LOG_NET_ALREADY_CONNECTED,  "WIFI is connected" )
+APPLOG_MSG( LOG_NET_CONNECTING,         "Connecting to the network using Wifi..." )
+APPLOG_MSG( LOG_NET_RETRY,              "Unable to connect to network (%ld). Retrying..." )
+APPLOG_MSG( LOG_NET_FAILED,             "ERROR: Connecting to the network failed (%ld)!" )
+APPLOG_MSG( LOG_NET_CONNECTED,          "Connected to the network successfully. IP address: %s" )
+APPLOG_MSG( LOG_APPLOG_DROPPED,         "applog: %lu records dropped" )
+APPLOG_MSG( LOG_POWER_SLEEP,            "entering low power mode after %lu ms idle" )
+APPLOG_MSG( LOG_POWER_WAKE,             "wake up on touch" )
+APPLOG_MSG( LOG_POWER_WAKE_PUBLISH,     "wake to first publish %lu ms" )
+APPLOG_MSG( LOG_LCD_POWER,              "display state %lu, estimated %lu uA, after %lu ms in state %lu" )
+APPLOG_MSG( LOG_LCD_WAKE,               "display wake to on %lu us" )
+APPLOG_MSG( LOG_NET_CONNECT_TIME,       "connected to ip in %lu ms, cold %lu, attempts %lu" )
+APPLOG_MSG( LOG_NET_LINK_LOST,          "network link lost (status %lu), reconnecting" )
+APPLOG_MSG( LOG_APPLOG_BENCH,           "applog bench %lu %lu %lu %lu %lu" )
+APPLOG_MSG( LOG_APPLOG_BENCH_STR,       "applog bench %s" )
@@ -21,8 +21,12 @@
 #include "aws_config.h"
 
 #include "lcd_ui.h"
+#include "applog.h"
+#include "eventbus.h"
+#include "boot.h"
 
 #include <map>
+#include <algorithm>
 
 
 
@@ -30,6 +34,7 @@
 NetworkInterface* _network;
 
 void awsiot_send(void);
+static void awsiot_retry_schedule(void);
 
 
 
@@ -38,6 +43,10 @@ void awsiot_send(void);
 #define AWSIOT_TIMEOUT_IN_USEC              (1000UL * 1000UL)
 #define AWSIOT_SEND_PERIOD_MS                2000
 
+/* Backoff of the reconnect while the link is up but AWS is not */
+#define AWSIOT_RETRY_MIN_MS                  (2000u)
+#define AWSIOT_RETRY_MAX_MS                  (60000u)
+
 DigitalOut led(LED1);
 
 
@@ -45,12 +54,38 @@ AWSIoTClient *client = NULL;
 aws_publish_params_t publish_params;
 
 
-Thread awsiot_thread(osPriorityNormal, 2048, NULL, "awsiot_send_thread");
-Semaphore awsiot_sem(1);
+/* Runs the TLS handshake of the connect on link up */
+Thread awsiot_thread(osPriorityNormal, 4096, NULL, "awsiot_send_thread");
+Mutex awsiot_send_mutex;
 EventQueue awiot_queue;
 
 map<string,string> awsiot_send_map;
 
+int awsiot_send_event_id = 0;
+int awsiot_retry_event_id = 0;
+uint32_t awsiot_retry_ms = AWSIOT_RETRY_MIN_MS;
+bool awsiot_link_up = false;
+bool awsiot_thread_started = false;
+void (*awsiot_publish_cb)(void) = NULL;
+
+/* Polled before each send, only the latest value of every widget is sent */
+eventbus_subscriber_t awsiot_subscriber;
+
+/* Drained by the send thread, a flapping link only acts on its latest state */
+eventbus_subscriber_t awsiot_link_subscriber;
+
+
+
+void awsiot_event_handler(const app_event_t *event){
+	switch(event->type){
+	case EVENT_BUTTON:
+		awsiot_add_message("button_"+to_string(event->id),to_string(event->value));
+		break;
+	case EVENT_SLIDER:
+		awsiot_add_message("slider_"+to_string(event->id),to_string(event->value));
+		break;
+	}
+}
 
 
 int awsiot_connect( NetworkInterface* network )
@@ -81,9 +116,9 @@ int awsiot_connect( NetworkInterface* network )
 
     if ( ( strlen(SSL_CLIENTKEY_PEM) | strlen(SSL_CLIENTCERT_PEM) | strlen(SSL_CA_PEM) ) < 64 )
     {
-    	   lcd_msg("aws_config.h error",0);
+    	   lcd_msg("aws_config.h error");
 
-        APP_INFO(( "Please configure SSL_CLIENTKEY_PEM, SSL_CLIENTCERT_PEM and SSL_CA_PEM in aws_config.h file\n" ));
+        APPLOG_ERROR(LOG_AWS_CONFIG_ERROR);
         return -1;
     }
 
@@ -104,12 +139,13 @@ int awsiot_connect( NetworkInterface* network )
     conn_params.peer_cn = (uint8_t*)AWSIOT_ENDPOINT_ADDRESS;
     conn_params.client_id = (uint8_t*)AWSIOT_THING_NAME;
 
-    /* connect to an AWS endpoint */
+    /* connect to an AWS endpoint, the TLS handshake */
+    boot_mark("tls start");
     result = client->connect( conn_params, endpoint_params );
     if ( result != CY_RSLT_SUCCESS )
     {
-    	lcd_msg("connection AWS failed %d",0,result);
-        APP_INFO(( "connection to AWS endpoint failed\r\n" ));
+    	lcd_msg("connection AWS failed %d",result);
+        APPLOG_ERROR(LOG_AWS_CONNECT_FAILED, result);
         if( client != NULL )
         {
             delete client;
@@ -118,14 +154,22 @@ int awsiot_connect( NetworkInterface* network )
         return -1;
     }
 
-    lcd_msg("connected to AWS ",0);
-    APP_INFO(( "Connected to AWS endpoint\r\n" ));
+    lcd_msg("connected to AWS ");
+    APPLOG_INFO(LOG_AWS_CONNECTED);
+    boot_mark("aws up");
 
 
 
     /*Start thread for send data batch to AWS period of time */
-    awsiot_thread.start(callback(&awiot_queue, &EventQueue::dispatch_forever));
-    awiot_queue.call_every(AWSIOT_SEND_PERIOD_MS, awsiot_send);
+    if (!awsiot_thread_started){
+    	eventbus_subscribe(&awsiot_subscriber, EVENTBUS_TYPE(EVENT_BUTTON) | EVENTBUS_TYPE(EVENT_SLIDER),
+    			EVENTBUS_TYPE(EVENT_BUTTON) | EVENTBUS_TYPE(EVENT_SLIDER), awsiot_event_handler, NULL);
+    	awsiot_thread.start(callback(&awiot_queue, &EventQueue::dispatch_forever));
+    	awsiot_thread_started = true;
+    }
+    if (awsiot_send_event_id)
+    	awiot_queue.cancel(awsiot_send_event_id);
+    awsiot_send_event_id = awiot_queue.call_every(AWSIOT_SEND_PERIOD_MS, awsiot_send);
 
 
 
@@ -142,8 +186,8 @@ int awsiot_publish( const char* message){
        result = client->publish( AWSIOT_TOPIC, message, strlen((char*)message), publish_params );
        if ( result != CY_RSLT_SUCCESS )
        {
-    	   lcd_msg("publish to AWS failed %d ",2,result);
-           APP_INFO(( "publish to topic failed\r\n" ));
+    	   lcd_msg("publish to AWS failed %d ",result);
+           APPLOG_ERROR(LOG_AWS_PUBLISH_FAILED, result);
 
 
 
@@ -153,44 +197,143 @@ int awsiot_publish( const char* message){
                delete client;
                client = NULL;
            }
+
+           /* nothing to send on until connected again */
+           if (awsiot_send_event_id){
+        	   awiot_queue.cancel(awsiot_send_event_id);
+        	   awsiot_send_event_id = 0;
+           }
+           awsiot_retry_schedule();
            return 1;
        }
 
        client->yield();
 
-       lcd_msg_delay_close("published to AWS",2,1000);
-       APP_INFO(( "Published to topic %s",message ));
+       if (awsiot_publish_cb)
+    	   awsiot_publish_cb();
+
+       lcd_msg("published to AWS");
+       APPLOG_DEBUG(LOG_AWS_PUBLISHED, strlen(message));
 
 
 }
 
 
 
-void awsiot_add_message(string name, string value){
-	awsiot_sem.try_acquire();
-	//awsiot_send_map.insert(pair<string,string>(name,value) );
+void awsiot_suspend_thread(){
+	awsiot_link_up = false;
 
-	awsiot_send_map[name]=value;
-	awsiot_sem.release();
+	if (awsiot_retry_event_id){
+		awiot_queue.cancel(awsiot_retry_event_id);
+		awsiot_retry_event_id = 0;
+	}
+
+	if (awsiot_send_event_id){
+		awiot_queue.cancel(awsiot_send_event_id);
+		awsiot_send_event_id = 0;
+	}
 
+	if (client){
+		client->disconnect();
+		delete client;
+		client = NULL;
+	}
+}
 
+void awsiot_suspend(){
+	if (awsiot_thread_started)
+		awiot_queue.call(awsiot_suspend_thread);
+}
+
+int awsiot_resume(){
+	if (client)
+		return 1;
+
+	int result = awsiot_connect(_network);
+
+	/* send whatever was collected while suspended without waiting a period */
+	if (result > 0){
+		awsiot_retry_ms = AWSIOT_RETRY_MIN_MS;
+		awiot_queue.call(awsiot_send);
+	} else {
+		awsiot_retry_schedule();
+	}
+
+	return result;
+}
+
+static void awsiot_retry_thread(void){
+	awsiot_retry_event_id = 0;
+
+	if (awsiot_link_up && !client)
+		awsiot_resume();
+}
+
+/* Called in the awsiot thread after a failed connect or publish */
+static void awsiot_retry_schedule(void){
+	if (!awsiot_link_up || awsiot_retry_event_id)
+		return;
+
+	awsiot_retry_event_id = awiot_queue.call_in(awsiot_retry_ms, awsiot_retry_thread);
+	awsiot_retry_ms = std::min<uint32_t>(awsiot_retry_ms * 2, AWSIOT_RETRY_MAX_MS);
+}
+
+void awsiot_link_handler(const app_event_t *event){
+	if (event->value){
+		awsiot_link_up = true;
+		awsiot_retry_ms = AWSIOT_RETRY_MIN_MS;
+		awsiot_resume();
+	} else {
+		awsiot_suspend_thread();
+	}
+}
+
+void awsiot_start( NetworkInterface* network ){
+	_network = network;
+
+	if (awsiot_thread_started)
+		return;
+
+	eventbus_subscribe(&awsiot_subscriber, EVENTBUS_TYPE(EVENT_BUTTON) | EVENTBUS_TYPE(EVENT_SLIDER),
+			EVENTBUS_TYPE(EVENT_BUTTON) | EVENTBUS_TYPE(EVENT_SLIDER), awsiot_event_handler, NULL);
+	eventbus_subscribe(&awsiot_link_subscriber, EVENTBUS_TYPE(EVENT_LINK), EVENTBUS_TYPE(EVENT_LINK),
+			awsiot_link_handler, &awiot_queue);
+	awsiot_thread.start(callback(&awiot_queue, &EventQueue::dispatch_forever));
+	awsiot_thread_started = true;
+}
+
+void awsiot_attach_publish(void (*cb)(void)){
+	awsiot_publish_cb = cb;
+}
+
+
+void awsiot_add_message(string name, string value){
+	awsiot_send_mutex.lock();
+	awsiot_send_map[name]=value;
+	awsiot_send_mutex.unlock();
 }
 
 
 void awsiot_send(){
 
+	map<string,string> send_map;
+
+	eventbus_poll(&awsiot_subscriber);
+
+	/* the publish runs unlocked, the stats timer may add meanwhile */
+	awsiot_send_mutex.lock();
+	send_map.swap(awsiot_send_map);
+	awsiot_send_mutex.unlock();
 
-	awsiot_sem.acquire();
-	 if (awsiot_send_map.empty()){
-		 printf("no message to send...\n");
-		// awsiot_sem.release();
+	 if (send_map.empty()){
+		 APPLOG_DEBUG(LOG_AWS_NO_MESSAGE);
 		 return;
 	 }
 	 string sendmessage = "{";
 
-	 for (std::map<string,string>::iterator it=awsiot_send_map.begin(); it!=awsiot_send_map.end(); ++it){
+	 for (std::map<string,string>::iterator it=send_map.begin(); it!=send_map.end(); ++it){
 
-		 if (it!=awsiot_send_map.begin())
+		 if (it!=send_map.begin())
 			 sendmessage.append(",");
 
 	 	sendmessage.append("\"");
@@ -204,15 +347,9 @@ void awsiot_send(){
 
 	 sendmessage.append("}");
 
-	 printf(sendmessage.c_str());
-	 printf("\n");
+	 APPLOG_DEBUG(LOG_AWS_SEND, send_map.size(), sendmessage.length());
 
 	 awsiot_publish(sendmessage.c_str());
 
-	 printf("published and reset map\n");
-
-	 awsiot_send_map.clear();
-	 awsiot_sem.release();
-
 }
 
@@ -22,6 +22,15 @@ using namespace std;
  */
 int awsiot_connect( NetworkInterface* network );
 
+/**
+ *
+ * Connect to AWS whenever the network link comes up and disconnect when
+ * it goes down, following EVENT_LINK
+ *
+ * @param NetworkInterface Interface of the Mbed Network, connected or not
+ */
+void awsiot_start( NetworkInterface* network );
+
 /**
  * Add new message for publish to aws, the message will send periodically.
  *
@@ -32,4 +41,28 @@ int awsiot_connect( NetworkInterface* network );
  */
 void awsiot_add_message(string name, string value);
 
+/**
+ *
+ * Stop periodic publishing and close the AWS connection, messages added
+ * meanwhile are kept for the next publish
+ *
+ */
+void awsiot_suspend(void);
+
+/**
+ *
+ * Connect to AWS again over the network of awsiot_connect() and publish
+ * the pending messages immediately, done on link up after awsiot_start()
+ *
+ * @return if 1 success
+ */
+int awsiot_resume(void);
+
+/**
+ *
+ * Set function called after every successful publish
+ *
+ */
+void awsiot_attach_publish(void (*cb)(void));
+
 #endif /* AWSIOT_H_ */
@@ -0,0 +1,407 @@
+/*
+ * boot.cpp
+ *
+ *  Boot graph, see boot.h
+ *
+ *      Author: sc lee
+ *
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#include "boot.h"
+
+#include "mbed.h"
+#include "cy_pdl.h"
+#include "console.h"
+#include "us_ticker_api.h"
+
+#include <string.h>
+
+
+#define BOOT_WAITING                            (0)
+#define BOOT_RUNNING                            (1)
+#define BOOT_DONE                               (2)
+#define BOOT_FAILED                             (3)
+#define BOOT_SKIPPED                            (4)
+
+typedef struct {
+	uint8_t state;
+	uint8_t worker;
+	int result;
+	uint32_t start_us;
+	uint32_t end_us;
+} boot_record_t;
+
+const char *boot_state_names[] = { "waiting", "running", "done", "failed", "skipped" };
+
+static const boot_stage_t *boot_stages;
+static int boot_count = 0;
+static boot_record_t boot_record[BOOT_MAX_STAGES];
+static uint32_t boot_end_us = 0;
+static int boot_worker_ids[BOOT_WORKERS];
+
+static Mutex boot_mutex;
+static ConditionVariable boot_cond(boot_mutex);
+
+
+/* Changes with the layout of boot_prof_t, a retained profile of another layout is dropped */
+#define BOOT_PROF_MAGIC                         (0x426f6f32u)
+
+/* Set by the reset hook, so the constructors know the profile has begun */
+#define BOOT_PROF_RESET_TOKEN                   (0x52657365u)
+
+/* The IMO runs the core until SystemInit() sets up the clocks */
+#define BOOT_PROF_RESET_HZ                      (8000000u)
+
+typedef struct {
+	char name[BOOT_PROF_NAME_SIZE];
+	uint32_t us;
+} boot_prof_mark_t;
+
+typedef struct {
+	uint32_t count;
+	boot_prof_mark_t marks[BOOT_PROF_MARKS];
+} boot_prof_run_t;
+
+/*
+ * Up to mbed_main() times are summed per interval of the cycle counter,
+ * each converted at the clock of its start. The counter wraps in 43 s at
+ * 100 MHz, so from mbed_main() on the marks are taken from the us ticker.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;                           /* boot number, run[seq & 1] is this boot */
+	uint32_t reset_token;
+	uint32_t last_cycles;
+	uint32_t last_hz;
+	uint32_t last_us;
+	uint32_t ticker;                        /* marks from the us ticker */
+	uint32_t ticker_base_us;                /* last_us when the ticker took over */
+	uint64_t ticker_start_us;
+	boot_prof_run_t run[2];
+} boot_prof_t;
+
+CY_NOINIT static boot_prof_t boot_prof;
+
+
+
+/*
+ * Called before .data and .bss are set up by the reset hook, so only
+ * boot_prof and the core registers are touched.
+ */
+static void boot_prof_begin(uint32_t hz)
+{
+	if (boot_prof.magic != BOOT_PROF_MAGIC || boot_prof.run[0].count > BOOT_PROF_MARKS ||
+			boot_prof.run[1].count > BOOT_PROF_MARKS) {
+		uint8_t *p = (uint8_t *)&boot_prof;
+
+		for (uint32_t i = 0; i < sizeof(boot_prof); i++)
+			p[i] = 0;
+		boot_prof.magic = BOOT_PROF_MAGIC;
+	} else {
+		boot_prof.seq++;
+	}
+
+	boot_prof.run[boot_prof.seq & 1].count = 0;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	boot_prof.last_cycles = 0;
+	boot_prof.last_hz = hz;
+	boot_prof.last_us = 0;
+	boot_prof.ticker = 0;
+}
+
+static void boot_prof_add(const char *name, uint32_t hz)
+{
+	boot_prof_run_t *run = &boot_prof.run[boot_prof.seq & 1];
+	int i;
+
+	if (boot_prof.ticker) {
+		boot_prof.last_us = boot_prof.ticker_base_us +
+				(uint32_t)(ticker_read_us(get_us_ticker_data()) - boot_prof.ticker_start_us);
+	} else {
+		uint32_t cycles = DWT->CYCCNT;
+		uint32_t mhz = boot_prof.last_hz / 1000000u;
+
+		boot_prof.last_us += (cycles - boot_prof.last_cycles) / (mhz ? mhz : 1u);
+		boot_prof.last_cycles = cycles;
+		boot_prof.last_hz = hz;
+	}
+
+	if (run->count >= BOOT_PROF_MARKS)
+		return;
+
+	boot_prof_mark_t *mark = &run->marks[run->count++];
+
+	for (i = 0; i < BOOT_PROF_NAME_SIZE - 1 && name[i]; i++)
+		mark->name[i] = name[i];
+	mark->name[i] = '\0';
+	mark->us = boot_prof.last_us;
+}
+
+static const boot_prof_mark_t *boot_prof_find(const boot_prof_run_t *run, const char *name)
+{
+	for (uint32_t i = 0; i < run->count; i++) {
+		if (!strncmp(run->marks[i].name, name, BOOT_PROF_NAME_SIZE - 1))
+			return &run->marks[i];
+	}
+
+	return NULL;
+}
+
+/* First code after reset, called by the PSoC 6 startup before .data init */
+extern "C" void Cy_OnResetUser(void)
+{
+	boot_prof_begin(BOOT_PROF_RESET_HZ);
+	boot_prof.reset_token = BOOT_PROF_RESET_TOKEN;
+	boot_prof_add("reset", BOOT_PROF_RESET_HZ);
+}
+
+/*
+ * Called by init_cycfg_system() in mbed_sdk_init() once SystemCoreClock is
+ * updated, so only the time up to here is converted at the IMO clock
+ */
+extern "C" void boot_clocks_ready(void)
+{
+	/* without the reset hook the profile has not begun yet */
+	if (boot_prof.reset_token == BOOT_PROF_RESET_TOKEN)
+		boot_mark("clocks");
+}
+
+/* Ahead of the C++ constructors of default priority, the global objects */
+__attribute__((constructor(101))) static void boot_prof_constructors(void)
+{
+	/* without the reset hook the profile starts here */
+	if (boot_prof.reset_token != BOOT_PROF_RESET_TOKEN)
+		boot_prof_begin(SystemCoreClock);
+
+	boot_prof.reset_token = 0;
+	boot_mark("ctors");
+}
+
+/* Called by the mbed boot after the constructors, before main() */
+extern "C" void mbed_main(void)
+{
+	boot_mark("mbed_main");
+
+	core_util_critical_section_enter();
+	boot_prof.ticker_start_us = ticker_read_us(get_us_ticker_data());
+	boot_prof.ticker_base_us = boot_prof.last_us;
+	boot_prof.ticker = 1;
+	core_util_critical_section_exit();
+}
+
+void boot_mark(const char *name)
+{
+	core_util_critical_section_enter();
+	if (!boot_prof_find(&boot_prof.run[boot_prof.seq & 1], name))
+		boot_prof_add(name, SystemCoreClock);
+	core_util_critical_section_exit();
+}
+
+
+static void boot_prof_print_raw(uint32_t seq)
+{
+	const boot_prof_run_t *run = &boot_prof.run[seq & 1];
+
+	for (uint32_t i = 0; i < run->count; i++)
+		printf("@B %lx %lx %lx %s\n", seq, i, run->marks[i].us, run->marks[i].name);
+}
+
+void boot_prof_dump(void)
+{
+	/* marks are only appended, the runs are read in place */
+	uint32_t seq = boot_prof.seq;
+	const boot_prof_run_t *run = &boot_prof.run[seq & 1];
+	const boot_prof_run_t *prev = &boot_prof.run[(seq + 1) & 1];
+	uint32_t count = run->count;
+
+	for (uint32_t i = 0; i < count; i++) {
+		const boot_prof_mark_t *mark = &run->marks[i];
+		/* no previous boot after a cold start */
+		const boot_prof_mark_t *last = seq ? boot_prof_find(prev, mark->name) : NULL;
+
+		printf("boot mark %-11s %8lu us +%7lu us", mark->name, mark->us, i ? mark->us - run->marks[i - 1].us : mark->us);
+		if (last)
+			printf(", %+ld us to the previous boot", (int32_t)(mark->us - last->us));
+		printf("\n");
+	}
+
+	const boot_prof_mark_t *booted = boot_prof_find(run, "booted");
+	if (booted && booted->us > BOOT_PROF_BUDGET_MS * 1000u)
+		printf("boot took %lu ms, over the %u ms budget\n", booted->us / 1000, BOOT_PROF_BUDGET_MS);
+
+	if (seq)
+		boot_prof_print_raw(seq - 1);
+	boot_prof_print_raw(seq);
+}
+
+
+/*
+ * Next stage whose dependencies are done, called with boot_mutex held.
+ * Stages behind a failed one are skipped on the way. Returns -1 if none
+ * is ready, *pending tells if any is still waiting.
+ */
+static int boot_next(bool *pending)
+{
+	uint32_t done = 0;
+	uint32_t broken = 0;
+
+	*pending = false;
+
+	for (int i = 0; i < boot_count; i++) {
+		boot_record_t *record = &boot_record[i];
+		uint32_t deps = boot_stages[i].deps;
+
+		if (record->state == BOOT_DONE)
+			done |= BOOT_DEP(i);
+		else if (record->state == BOOT_FAILED || record->state == BOOT_SKIPPED)
+			broken |= BOOT_DEP(i);
+
+		if (record->state != BOOT_WAITING)
+			continue;
+
+		/* stages are in dependency order, so a skip is seen by the later ones */
+		if (deps & broken) {
+			record->state = BOOT_SKIPPED;
+			broken |= BOOT_DEP(i);
+			continue;
+		}
+
+		if ((deps & done) == deps)
+			return i;
+
+		*pending = true;
+	}
+
+	return -1;
+}
+
+static void boot_worker(int *worker)
+{
+	boot_mutex.lock();
+
+	while (true) {
+		bool pending;
+		int i = boot_next(&pending);
+
+		if (i < 0) {
+			if (!pending)
+				break;
+
+			boot_cond.wait();
+			continue;
+		}
+
+		boot_record[i].state = BOOT_RUNNING;
+		boot_record[i].worker = *worker;
+		boot_record[i].start_us = us_ticker_read();
+		boot_mutex.unlock();
+
+		int result = boot_stages[i].init();
+
+		boot_mark(boot_stages[i].name);
+
+		boot_mutex.lock();
+		boot_record[i].end_us = us_ticker_read();
+		boot_record[i].result = result;
+		boot_record[i].state = result ? BOOT_FAILED : BOOT_DONE;
+		boot_cond.notify_all();
+	}
+
+	boot_mutex.unlock();
+}
+
+
+static void boot_print(void)
+{
+	boot_mutex.lock();
+	for (int i = 0; i < boot_count; i++) {
+		boot_record_t *record = &boot_record[i];
+
+		if (record->state == BOOT_SKIPPED || record->state == BOOT_WAITING) {
+			printf("boot %-10s %s\n", boot_stages[i].name, boot_state_names[record->state]);
+			continue;
+		}
+
+		printf("boot %-10s %6lu.%lu .. %6lu.%lu ms %5lu.%lu ms worker %u %s", boot_stages[i].name,
+				record->start_us / 1000, record->start_us / 100 % 10,
+				record->end_us / 1000, record->end_us / 100 % 10,
+				(record->end_us - record->start_us) / 1000, (record->end_us - record->start_us) / 100 % 10,
+				record->worker, boot_state_names[record->state]);
+		if (record->state == BOOT_FAILED)
+			printf(" (%d)", record->result);
+		printf("\n");
+	}
+	if (boot_end_us)
+		printf("boot all stages settled at %lu ms\n", boot_end_us / 1000);
+	boot_mutex.unlock();
+}
+
+static void boot_cmd(int argc, char *argv[])
+{
+	if (argc > 1 && !strcmp(argv[1], "prof"))
+		boot_prof_dump();
+	else
+		boot_print();
+}
+
+
+int boot_run(const boot_stage_t *stages, int count)
+{
+	Thread *workers[BOOT_WORKERS - 1];
+	int failed = 0;
+
+	if (count > BOOT_MAX_STAGES)
+		count = BOOT_MAX_STAGES;
+
+	boot_mutex.lock();
+	boot_stages = stages;
+	boot_count = count;
+	memset(boot_record, 0, sizeof(boot_record));
+
+	/* a dependency on itself or a later stage could never be met */
+	for (int i = 0; i < count; i++) {
+		if (stages[i].deps & ~(BOOT_DEP(i) - 1u)) {
+			boot_record[i].state = BOOT_FAILED;
+			boot_record[i].result = -1;
+		}
+	}
+	boot_mutex.unlock();
+
+	console_register("boot", "[prof], stage timeline of the boot graph, marks since reset", boot_cmd);
+
+	/* the worker stacks are freed again once the graph is through */
+	for (int w = 0; w < BOOT_WORKERS; w++)
+		boot_worker_ids[w] = w;
+
+	for (int w = 1; w < BOOT_WORKERS; w++) {
+		workers[w - 1] = new Thread(osPriorityNormal, BOOT_WORKER_STACK_SIZE, NULL, "boot_worker");
+		if (workers[w - 1])
+			workers[w - 1]->start(callback(boot_worker, &boot_worker_ids[w]));
+	}
+
+	boot_worker(&boot_worker_ids[0]);
+
+	for (int w = 1; w < BOOT_WORKERS; w++) {
+		if (workers[w - 1]) {
+			workers[w - 1]->join();
+			delete workers[w - 1];
+		}
+	}
+
+	boot_end_us = us_ticker_read();
+	boot_mark("booted");
+
+	for (int i = 0; i < count; i++) {
+		if (boot_record[i].state != BOOT_DONE)
+			failed++;
+	}
+
+	boot_print();
+	boot_prof_dump();
+	return failed;
+}
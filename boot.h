@@ -0,0 +1,86 @@
+/*
+ * boot.h
+ *
+ *  Boot graph
+ *
+ *  Every stage names the stages it depends on and starts as soon as they
+ *  are done, stages without a dependency between them run in parallel on
+ *  a few boot workers. A failed stage skips the stages depending on it,
+ *  the others go on. The start and end of every stage is kept for the
+ *  timeline printed by boot_run() and the "boot" command.
+ *
+ *  The boot profiler records named marks from the reset handler on, the
+ *  clock setup, the static constructors, main(), every boot stage and the
+ *  first Wi-Fi join, TLS connect and touch. Marks up to mbed_main() come
+ *  from the cycle counter, later ones from the us ticker, which does not
+ *  wrap within a boot. The marks of the current and the previous boot are
+ *  kept in RAM which is not initialized at reset, so they survive a warm
+ *  reset, e.g. after a hang. They are dumped at the end of boot_run()
+ *  with the difference to the previous boot, and as "@B" lines for the
+ *  host: @B <boot> <mark> <us since reset> <name>, numbers in hex.
+ *
+ *      Author: sc lee
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include <stdint.h>
+
+#define BOOT_MAX_STAGES                         (16)
+
+/* Workers including the calling thread */
+#ifndef BOOT_WORKERS
+#define BOOT_WORKERS                            (3)
+#endif
+
+#define BOOT_WORKER_STACK_SIZE                  (2048)
+
+#define BOOT_DEP(stage)                         (1u << (stage))
+
+#define BOOT_PROF_MARKS                         (32)
+#define BOOT_PROF_NAME_SIZE                     (12)
+
+/* Reset to the end of boot_run() above this is reported */
+#ifndef BOOT_PROF_BUDGET_MS
+#define BOOT_PROF_BUDGET_MS                     (1000u)
+#endif
+
+typedef struct {
+	const char *name;
+	uint32_t deps;                          /* BOOT_DEP() of the stages run first */
+	int (*init)(void);                      /* 0 if success */
+} boot_stage_t;
+
+/**
+ *
+ * Run the stages, returns when every stage is done, failed or skipped
+ *
+ * @param stages the stages, a stage may only depend on stages before it
+ * @param count number of stages, up to BOOT_MAX_STAGES
+ * @return number of failed and skipped stages
+ *
+ */
+int boot_run(const boot_stage_t *stages, int count);
+
+/**
+ *
+ * Record the time since reset under a name, from any thread or interrupt.
+ * Only the first mark of a name counts, so a mark on a path which repeats
+ * keeps the first time.
+ *
+ * @param name the mark, up to BOOT_PROF_NAME_SIZE - 1 characters are kept
+ *
+ */
+void boot_mark(const char *name);
+
+/**
+ *
+ * Print the marks of this boot with the difference to the previous one,
+ * and the "@B" lines of both
+ *
+ */
+void boot_prof_dump(void);
+
+#endif /* BOOT_H_ */
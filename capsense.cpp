@@ -7,8 +7,10 @@
 *   OS. This example implements two button widgets and a slider widget, turns an
 *   LED ON when any of the widgets is touched and OFF when none of them are
 *   touched, and prints the button status and slider position over serial port.
-*   This example enables CapSense Tuner communication over I2C for CapSense data
-*   monitoring. This example uses the following RTOS objects and runs a thread
+*   CapSense Tuner communication over I2C for CapSense data monitoring is
+*   enabled on demand, by holding the user button at reset or by the "tuner"
+*   console command, and compiled out with CAPSENSE_TUNER_ENABLE=0. This
+*   example uses the following RTOS objects and runs a thread
 *   for periodic CapSense scan apart from the main() thread.
 *
 *   Semaphore:  The scan loop calls wait() to obtain the Semaphore after
@@ -33,8 +35,16 @@
 #include "cycfg_capsense.h"
 #include "cycfg.h"
 #include "cybsp.h"
-#include "lcd_ui.h"
+#include "eventbus.h"
 #include "awsiot.h"
+#include "applog.h"
+#include "console.h"
+#include "perf.h"
+#include "power.h"
+#include "capsense.h"
+#include "boot.h"
+
+#include <string.h>
 
 DigitalOut ledStatus(CYBSP_USER_LED4);
 
@@ -43,19 +53,46 @@ DigitalOut ledStatus(CYBSP_USER_LED4);
  */
 #define CAPSENSE_SCAN_PERIOD_MS                 (20u)
 
+/* A scan period longer than this is counted as late */
+#define CAPSENSE_LATE_TOLERANCE_MS              (2u)
+
+/* Low power mode scans only this widget, at a slower rate */
+#define CAPSENSE_WAKE_WIDGET_ID                 (CY_CAPSENSE_BUTTON0_WDGT_ID)
+#define CAPSENSE_LP_SCAN_PERIOD_MS              (200u)
+
+/* Period of the scan statistics summary added to the AWS messages */
+#define CAPSENSE_STATS_PERIOD_MS                (60000u)
+
 #define SLIDER_NUM_TOUCH                        (1u)
 #define LED_OFF                                 (1u)
 #define LED_ON                                  (0u)
 
 
-#define CAPSENSE_DRAW_LCD
+/* CapSense Tuner over EZI2C
+ *   0: compiled out, EZI2C is never initialized
+ *   1: available on demand, enabled by holding CAPSENSE_TUNER_STRAP at reset
+ *      or by the "tuner on" console command
+ */
+#ifndef CAPSENSE_TUNER_ENABLE
+#define CAPSENSE_TUNER_ENABLE                   (1)
+#endif
+
+#define CAPSENSE_TUNER_STRAP                    (CYBSP_USER_BTN)
 
 
 /***************************************
 * Function Prototypes
 **************************************/
 void RunCapSenseScan(void);
+void RunCapSenseLowPowerScan(void);
+void capsense_set_low_power(bool enable);
 void InitTunerCommunication(void);
+void DeinitTunerCommunication(void);
+void capsense_tuner_switch(bool enable);
+void capsense_tuner_enable(bool enable);
+void capsense_tuner_cmd(int argc, char *argv[]);
+void capsense_stats_cmd(int argc, char *argv[]);
+void capsense_stats_publish(void);
 void ProcessTouchStatus(void);
 void EZI2C_InterruptHandler(void);
 void CapSense_InterruptHandler(void);
@@ -70,10 +107,12 @@ const cy_stc_sysint_t CapSense_ISR_cfg =
     .intrPriority = 4u
 };
 
+#if CAPSENSE_TUNER_ENABLE
 const cy_stc_sysint_t EZI2C_ISR_cfg = {
     .intrSrc = CYBSP_CSD_COMM_IRQ,
     .intrPriority = 3u
 };
+#endif
 
 
 /*******************************************************************************
@@ -82,10 +121,48 @@ const cy_stc_sysint_t EZI2C_ISR_cfg = {
 Thread capsense_thread(osPriorityNormal, 2048, NULL, "capSense_scan_thread");
 Semaphore capsense_sem;
 EventQueue capsense_queue;
+#if CAPSENSE_TUNER_ENABLE
 cy_stc_scb_ezi2c_context_t EZI2C_context;
+#endif
 uint32_t prevBtn0Status = 0u;
 uint32_t prevBtn1Status = 0u;
 uint32_t prevSliderPos = 0u;
+bool firstTouchMarked = false;
+
+/* Event IDs of the periodic scans, only one of them is scheduled */
+int scanEventId = 0;
+int lowPowerScanEventId = 0;
+
+
+/* Tuner state and per-scan processing time, index 0 tuner off, 1 tuner on */
+volatile bool tunerEnabled = false;
+volatile uint32_t ezi2cIrqCount = 0u;
+perf_stat_t tunerProcStat[2];
+uint32_t tunerIrqCount[2];
+
+
+/* Scan loop instrumentation, one statistic per stage of RunCapSenseScan() */
+enum {
+    CAPSENSE_STAGE_START,       /* Cy_CapSense_ScanAllWidgets() call */
+    CAPSENSE_STAGE_SCAN,        /* scan start to end-of-scan callback */
+    CAPSENSE_STAGE_WAKEUP,      /* end-of-scan callback to scan thread running */
+    CAPSENSE_STAGE_PROCESS,     /* Cy_CapSense_ProcessAllWidgets() */
+    CAPSENSE_STAGE_TUNER,       /* Cy_CapSense_RunTuner() */
+    CAPSENSE_STAGE_TOUCH,       /* ProcessTouchStatus() */
+    CAPSENSE_STAGE_TOTAL,       /* whole RunCapSenseScan() */
+    CAPSENSE_STAGE_PERIOD,      /* interval between RunCapSenseScan() calls */
+    CAPSENSE_STAGE_COUNT
+};
+
+const char * const capsenseStageName[CAPSENSE_STAGE_COUNT] = {
+    "start", "scan", "wakeup", "process", "tuner", "touch", "total", "period"
+};
+
+perf_stat_t capsenseStat[CAPSENSE_STAGE_COUNT];
+volatile uint32_t scanDoneCycles = 0u;
+uint32_t lastRunCycles = 0u;
+uint32_t capsenseOverruns = 0u;
+uint32_t capsenseLate = 0u;
 
 
 
@@ -112,14 +189,25 @@ cy_stc_syspm_callback_t capsenseDeepSleepCb =
 * Function Name: capsense_init()
 ********************************************************************************
 * Summary:
-*   Main function that starts a thread for CapSense scan and enters a forever
-*   wait state.
+*   Starts a thread for CapSense scan, returns 0 if success or -1 if the
+*   CapSense block could not be initialized.
 *
 *******************************************************************************/
 int capsense_init()
 {
 
-    InitTunerCommunication();
+#if CAPSENSE_TUNER_ENABLE
+    DigitalIn tunerStrap(CAPSENSE_TUNER_STRAP, PullUp);
+
+    /* Strap is active low, the user button pressed at reset */
+    if (!tunerStrap)
+        capsense_tuner_switch(true);
+#endif
+
+    console_register("tuner", "on|off|stat|reset, CapSense tuner over EZI2C", capsense_tuner_cmd);
+    console_register("cs", "stat|reset, CapSense scan timing", capsense_stats_cmd);
+
+    perf_init();
 
     /* Initialize the CSD HW block to the default state. */
     cy_status status = Cy_CapSense_Init(&cy_capsense_context);
@@ -127,7 +215,7 @@ int capsense_init()
     if(CY_RET_SUCCESS != status)
     {
         printf("CapSense initialization failed. Status code: %lu\r\n", status);
-        ThisThread::sleep_for(osWaitForever);
+        return -1;
     }
 
     /* Initialize CapSense interrupt */
@@ -146,7 +234,8 @@ int capsense_init()
      */
 
     capsense_thread.start(callback(&capsense_queue, &EventQueue::dispatch_forever));
-    capsense_queue.call_every(CAPSENSE_SCAN_PERIOD_MS, RunCapSenseScan);
+    scanEventId = capsense_queue.call_every(CAPSENSE_SCAN_PERIOD_MS, RunCapSenseScan);
+    capsense_queue.call_every(CAPSENSE_STATS_PERIOD_MS, capsense_stats_publish);
 
     /* Initiate scan immediately since the first call of RunCapSenseScan()
      * happens CAPSENSE_SCAN_PERIOD_MS after the event queue dispatcher has
@@ -156,8 +245,7 @@ int capsense_init()
 
     printf("Application has started. Touch any CapSense button or slider.\r\n");
 
-
-
+    return 0;
 }
 
 
@@ -171,20 +259,144 @@ int capsense_init()
 *******************************************************************************/
 void RunCapSenseScan(void)
 {
+    const uint32_t cyclesPerMs = SystemCoreClock / 1000u;
+    bool scanStarted = false;
+    uint32_t tRun = perf_cycles();
+
+    if (lastRunCycles)
+    {
+        uint32_t period = tRun - lastRunCycles;
+
+        perf_stat_add(&capsenseStat[CAPSENSE_STAGE_PERIOD], period);
+        if (period > (CAPSENSE_SCAN_PERIOD_MS + CAPSENSE_LATE_TOLERANCE_MS) * cyclesPerMs)
+            capsenseLate++;
+    }
+    lastRunCycles = tRun;
+
     Cy_CapSense_Wakeup(&cy_capsense_context);
 
     if (CY_CAPSENSE_NOT_BUSY == Cy_CapSense_IsBusy(&cy_capsense_context))
     {
         Cy_CapSense_ScanAllWidgets(&cy_capsense_context);
+        scanStarted = true;
     }
 
+    uint32_t tStarted = perf_cycles();
+
     capsense_sem.acquire();
+
+    uint32_t tWoken = perf_cycles();
+
     Cy_CapSense_ProcessAllWidgets(&cy_capsense_context);
-    Cy_CapSense_RunTuner(&cy_capsense_context);
+
+    uint32_t tProcessed = perf_cycles();
+
+#if CAPSENSE_TUNER_ENABLE
+    if (tunerEnabled)
+        Cy_CapSense_RunTuner(&cy_capsense_context);
+#endif
+
+    uint32_t tTuned = perf_cycles();
+
     ProcessTouchStatus();
+
+    uint32_t tDone = perf_cycles();
+
+    if (scanStarted)
+    {
+        perf_stat_add(&capsenseStat[CAPSENSE_STAGE_START], tStarted - tRun);
+        perf_stat_add(&capsenseStat[CAPSENSE_STAGE_SCAN], scanDoneCycles - tStarted);
+        perf_stat_add(&capsenseStat[CAPSENSE_STAGE_WAKEUP], tWoken - scanDoneCycles);
+    }
+    perf_stat_add(&capsenseStat[CAPSENSE_STAGE_PROCESS], tProcessed - tWoken);
+    if (tunerEnabled)
+        perf_stat_add(&capsenseStat[CAPSENSE_STAGE_TUNER], tTuned - tProcessed);
+    perf_stat_add(&capsenseStat[CAPSENSE_STAGE_TOUCH], tDone - tTuned);
+    perf_stat_add(&capsenseStat[CAPSENSE_STAGE_TOTAL], tDone - tRun);
+    perf_stat_add(&tunerProcStat[tunerEnabled ? 1 : 0], tDone - tWoken);
+
+    if (tDone - tRun > CAPSENSE_SCAN_PERIOD_MS * cyclesPerMs)
+        capsenseOverruns++;
+}
+
+
+/*******************************************************************************
+* Function Name: RunCapSenseLowPowerScan()
+********************************************************************************
+* Summary:
+*   Scans and processes only the wake widget. A touch on it switches back to
+*   the full scan and wakes up the rest of the system. Between these scans
+*   the scan thread sleeps, so the device can enter deep sleep, the
+*   capsenseDeepSleepCb registered in capsense_init() holds deep sleep off
+*   while a scan is in progress.
+*
+*******************************************************************************/
+void RunCapSenseLowPowerScan(void)
+{
+    Cy_CapSense_Wakeup(&cy_capsense_context);
+
+    if (CY_CAPSENSE_NOT_BUSY != Cy_CapSense_IsBusy(&cy_capsense_context))
+        return;
+
+    Cy_CapSense_SetupWidget(CAPSENSE_WAKE_WIDGET_ID, &cy_capsense_context);
+    Cy_CapSense_Scan(&cy_capsense_context);
+
+    capsense_sem.acquire();
+    Cy_CapSense_ProcessWidget(CAPSENSE_WAKE_WIDGET_ID, &cy_capsense_context);
+
+    if (Cy_CapSense_IsWidgetActive(CAPSENSE_WAKE_WIDGET_ID, &cy_capsense_context))
+    {
+        capsense_low_power(false);
+        power_wake();
+    }
+}
+
+
+/*******************************************************************************
+* Function Name: capsense_set_low_power(), capsense_low_power()
+********************************************************************************
+* Summary:
+*   Swaps the periodic full scan for the slow wake widget scan and back.
+*   The switch always runs as its own event of the scan thread, so neither
+*   periodic event is cancelled from inside its own callback.
+*
+*******************************************************************************/
+void capsense_set_low_power(bool enable)
+{
+    if (enable == (lowPowerScanEventId != 0))
+        return;
+
+    if (enable)
+    {
+        capsense_queue.cancel(scanEventId);
+        scanEventId = 0;
+        lowPowerScanEventId = capsense_queue.call_every(CAPSENSE_LP_SCAN_PERIOD_MS, RunCapSenseLowPowerScan);
+    }
+    else
+    {
+        capsense_queue.cancel(lowPowerScanEventId);
+        lowPowerScanEventId = 0;
+
+        /* Do not count the low power gap as a late period */
+        lastRunCycles = 0u;
+        scanEventId = capsense_queue.call_every(CAPSENSE_SCAN_PERIOD_MS, RunCapSenseScan);
+        capsense_queue.call(RunCapSenseScan);
+    }
+}
+
+void capsense_low_power(bool enable)
+{
+    capsense_queue.call(capsense_set_low_power, enable);
+}
+
+/* tunerEnabled stays false while the tuner is compiled out */
+bool capsense_can_sleep(void)
+{
+    return !tunerEnabled;
 }
 
 
+#if CAPSENSE_TUNER_ENABLE
 /*******************************************************************************
 * Function Name: InitTunerCommunication
 ********************************************************************************
@@ -214,13 +426,149 @@ void InitTunerCommunication(void)
 }
 
 
+/*******************************************************************************
+* Function Name: DeinitTunerCommunication
+********************************************************************************
+*
+* Summary:
+*   Disables the EZI2C interrupt and block, so no tuner traffic is serviced.
+*
+*******************************************************************************/
+void DeinitTunerCommunication(void)
+{
+    NVIC_DisableIRQ(EZI2C_ISR_cfg.intrSrc);
+    NVIC_ClearPendingIRQ(EZI2C_ISR_cfg.intrSrc);
+
+    Cy_SCB_EZI2C_Disable(CYBSP_CSD_COMM_HW, &EZI2C_context);
+    Cy_SCB_EZI2C_DeInit(CYBSP_CSD_COMM_HW);
+}
+#endif /* CAPSENSE_TUNER_ENABLE */
+
+
+/*******************************************************************************
+* Function Name: capsense_tuner_switch
+********************************************************************************
+*
+* Summary:
+*   Switches tuner support on or off. Called from the scan thread, or before
+*   it has started, so the EZI2C block never changes state in the middle of
+*   Cy_CapSense_RunTuner().
+*
+*******************************************************************************/
+void capsense_tuner_switch(bool enable)
+{
+#if CAPSENSE_TUNER_ENABLE
+    if (enable == tunerEnabled)
+        return;
+
+    tunerIrqCount[tunerEnabled ? 1 : 0] += ezi2cIrqCount;
+    ezi2cIrqCount = 0u;
+
+    if (enable)
+        InitTunerCommunication();
+    else
+        DeinitTunerCommunication();
+
+    tunerEnabled = enable;
+#else
+    if (enable)
+        printf("tuner support is compiled out (CAPSENSE_TUNER_ENABLE)\n");
+#endif
+}
+
+void capsense_tuner_enable(bool enable)
+{
+    capsense_queue.call(capsense_tuner_switch, enable);
+}
+
+
+static void capsense_tuner_print_stat(int mode, uint32_t irq)
+{
+    perf_stat_t *stat = &tunerProcStat[mode];
+
+    printf("tuner %-3s scans: %lu avg: %lu us max: %lu us ezi2c irq: %lu\n", mode ? "on" : "off", stat->count,
+           perf_stat_avg_us(stat), perf_cycles_to_us(stat->max), tunerIrqCount[mode] + irq);
+}
+
+void capsense_tuner_cmd(int argc, char *argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "on")) {
+        capsense_tuner_enable(true);
+    } else if (argc > 1 && !strcmp(argv[1], "off")) {
+        capsense_tuner_enable(false);
+    } else if (argc > 1 && !strcmp(argv[1], "reset")) {
+        perf_stat_reset(&tunerProcStat[0]);
+        perf_stat_reset(&tunerProcStat[1]);
+        memset(tunerIrqCount, 0, sizeof(tunerIrqCount));
+        ezi2cIrqCount = 0u;
+    } else {
+        printf("tuner is %s\n", tunerEnabled ? "on" : "off");
+        capsense_tuner_print_stat(0, tunerEnabled ? 0u : ezi2cIrqCount);
+        capsense_tuner_print_stat(1, tunerEnabled ? ezi2cIrqCount : 0u);
+    }
+}
+
+
+/*******************************************************************************
+* Function Name: capsense_stats_reset(), capsense_stats_cmd()
+********************************************************************************
+*
+* Summary:
+*   Clears the scan loop statistics in the scan thread, and the console
+*   command printing or clearing them.
+*
+*******************************************************************************/
+void capsense_stats_reset(void)
+{
+    for (int i = 0; i < CAPSENSE_STAGE_COUNT; i++)
+        perf_stat_reset(&capsenseStat[i]);
+
+    lastRunCycles = 0u;
+    capsenseOverruns = 0u;
+    capsenseLate = 0u;
+}
+
+void capsense_stats_cmd(int argc, char *argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "reset"))
+    {
+        capsense_queue.call(capsense_stats_reset);
+        return;
+    }
+
+    for (int i = 0; i < CAPSENSE_STAGE_COUNT; i++)
+        perf_stat_print(capsenseStageName[i], &capsenseStat[i]);
+
+    printf("overruns: %lu late: %lu (period %u ms)\n", capsenseOverruns, capsenseLate, CAPSENSE_SCAN_PERIOD_MS);
+}
+
+
+/*******************************************************************************
+* Function Name: capsense_stats_publish
+********************************************************************************
+*
+* Summary:
+*   Adds a summary of the scan loop timing to the AWS messages.
+*
+*******************************************************************************/
+void capsense_stats_publish(void)
+{
+    awsiot_add_message("scan_avg_us", to_string(perf_stat_avg_us(&capsenseStat[CAPSENSE_STAGE_TOTAL])));
+    awsiot_add_message("scan_max_us", to_string(perf_cycles_to_us(capsenseStat[CAPSENSE_STAGE_TOTAL].max)));
+    awsiot_add_message("scan_period_max_us", to_string(perf_cycles_to_us(capsenseStat[CAPSENSE_STAGE_PERIOD].max)));
+    awsiot_add_message("scan_overruns", to_string(capsenseOverruns));
+    awsiot_add_message("scan_late", to_string(capsenseLate));
+}
+
+
 /*******************************************************************************
 * Function Name: ProcessTouchStatus
 ********************************************************************************
 *
 * Summary:
 *
-*   Call awsiot function for publishing data to AWS
+*   Publish button and slider changes on the event bus, stamped with the
+*   end of the scan that saw them for the touch to display latency
 *
 *******************************************************************************/
 void ProcessTouchStatus(void)
@@ -232,30 +580,16 @@ void ProcessTouchStatus(void)
 
     if(currBtn0Status != prevBtn0Status)
     {
-        printf("Button_0 status: %lu\r\n", currBtn0Status);
+        APPLOG_INFO(LOG_CAPSENSE_BUTTON, 0u, currBtn0Status);
         prevBtn0Status = currBtn0Status;
-#ifdef CAPSENSE_DRAW_LCD
-        if (currBtn0Status)
-        	lcd_show_button(0);
-        else
-        	lcd_close_button(0);
-#endif
-
-        awsiot_add_message("button_0",to_string(currBtn0Status));
+        eventbus_publish_origin(EVENT_BUTTON, 0, currBtn0Status, scanDoneCycles);
     }
 
     if(currBtn1Status != prevBtn1Status)
     {
-        printf("Button_1 status: %lu\r\n", currBtn1Status);
+        APPLOG_INFO(LOG_CAPSENSE_BUTTON, 1u, currBtn1Status);
         prevBtn1Status = currBtn1Status;
-#ifdef CAPSENSE_DRAW_LCD
-        if (currBtn1Status)
-        	lcd_show_button(1);
-        else
-        	lcd_close_button(1);
-#endif
-
-        awsiot_add_message("button_1",to_string(currBtn1Status));
+        eventbus_publish_origin(EVENT_BUTTON, 1, currBtn1Status, scanDoneCycles);
     }
 
     if (sldrTouch->numPosition == SLIDER_NUM_TOUCH)
@@ -264,17 +598,26 @@ void ProcessTouchStatus(void)
 
         if(currSliderPos != prevSliderPos)
         {
-            printf("Slider position: %lu\r\n", currSliderPos);
+            APPLOG_INFO(LOG_CAPSENSE_SLIDER, currSliderPos);
             prevSliderPos = currSliderPos;
-            awsiot_add_message("slider_0",to_string(currSliderPos));
+            eventbus_publish_origin(EVENT_SLIDER, 0, currSliderPos, scanDoneCycles);
         }
+    }
 
-#ifdef CAPSENSE_DRAW_LCD
-        lcd_show_slice(currSliderPos);
-#endif
+    bool touched = currBtn0Status || currBtn1Status || (SLIDER_NUM_TOUCH == sldrTouch->numPosition);
+
+    if (touched)
+    {
+        power_activity();
+
+        if (!firstTouchMarked)
+        {
+            boot_mark("first touch");
+            firstTouchMarked = true;
+        }
     }
 
-    ledStatus = (currBtn0Status || currBtn1Status || (SLIDER_NUM_TOUCH == sldrTouch->numPosition)) ? LED_ON : LED_OFF;
+    ledStatus = touched ? LED_ON : LED_OFF;
 }
 
 
@@ -285,10 +628,13 @@ void ProcessTouchStatus(void)
 *   Wrapper function for handling interrupts from EZI2C block.
 *
 *******************************************************************************/
+#if CAPSENSE_TUNER_ENABLE
 void EZI2C_InterruptHandler(void)
 {
+    ezi2cIrqCount++;
     Cy_SCB_EZI2C_Interrupt(CYBSP_CSD_COMM_HW, &EZI2C_context);
 }
+#endif
 
 
 /*******************************************************************************
@@ -316,5 +662,6 @@ void CapSense_InterruptHandler(void)
 *******************************************************************************/
 void CapSenseEndOfScanCallback(cy_stc_active_scan_sns_t * ptrActiveScan)
 {
+    scanDoneCycles = perf_cycles();
     capsense_sem.release();
 }
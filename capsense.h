@@ -12,8 +12,26 @@
  *
  * capsense startup
  *
+ * @return 0 if success, -1 if the CapSense block failed to initialize
  */
 	int capsense_init(void);
 
+/**
+ *
+ * Switch between the full scan and the slow scan of the wake widget only,
+ * a touch on the wake widget switches back by itself and calls power_wake()
+ *
+ * @param enable true for the low power scan
+ *
+ */
+	void capsense_low_power(bool enable);
+
+/**
+ *
+ * Check if the low power scan may be used, not while the tuner is attached
+ *
+ */
+	bool capsense_can_sleep(void);
+
 
 #endif /* CAPSENSE_H_ */
@@ -0,0 +1,120 @@
+/*
+ * console.cpp
+ *
+ *  Serial command console, see console.h
+ *
+ *      Author: sc lee
+ *
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#include "console.h"
+
+#include "mbed.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+typedef struct {
+	const char *name;
+	const char *help;
+	console_handler_t handler;
+} console_cmd_t;
+
+
+static console_cmd_t console_cmds[CONSOLE_MAX_COMMANDS];
+static int console_num_cmds = 0;
+static Mutex console_cmds_mutex;
+
+Thread console_thread(osPriorityLow, 2048, NULL, "console_thread");
+
+
+
+/* Boot stages register from several threads, the count goes up last */
+int console_register(const char *name, const char *help, console_handler_t handler)
+{
+	int result = -1;
+
+	console_cmds_mutex.lock();
+	if (console_num_cmds < CONSOLE_MAX_COMMANDS) {
+		console_cmds[console_num_cmds].name = name;
+		console_cmds[console_num_cmds].help = help;
+		console_cmds[console_num_cmds].handler = handler;
+		console_num_cmds++;
+		result = 0;
+	}
+	console_cmds_mutex.unlock();
+
+	return result;
+}
+
+
+static void console_help(int argc, char *argv[])
+{
+	for (int i = 0; i < console_num_cmds; i++)
+		printf("%-10s %s\n", console_cmds[i].name, console_cmds[i].help);
+}
+
+static void console_execute(char *line)
+{
+	char *argv[CONSOLE_MAX_ARGS];
+	int argc = 0;
+	char *save;
+
+	for (char *tok = strtok_r(line, " \t", &save); tok && argc < CONSOLE_MAX_ARGS; tok = strtok_r(NULL, " \t", &save))
+		argv[argc++] = tok;
+
+	if (!argc)
+		return;
+
+	for (int i = 0; i < console_num_cmds; i++) {
+		if (!strcmp(argv[0], console_cmds[i].name)) {
+			console_cmds[i].handler(argc, argv);
+			return;
+		}
+	}
+
+	printf("unknown command: %s, try help\n", argv[0]);
+}
+
+static void console_loop(void)
+{
+	char line[CONSOLE_LINE_SIZE];
+	int len = 0;
+
+	while (true) {
+		int c = getchar();
+
+		if (c == EOF) {
+			ThisThread::sleep_for(100);
+			continue;
+		}
+
+		if (c == '\r' || c == '\n') {
+			line[len] = '\0';
+			console_execute(line);
+			len = 0;
+			continue;
+		}
+
+		if (len < CONSOLE_LINE_SIZE - 1)
+			line[len++] = (char)c;
+	}
+}
+
+
+void console_enable_input(bool enable)
+{
+	FileHandle *stdin_handle = mbed_file_handle(STDIN_FILENO);
+
+	if (stdin_handle)
+		stdin_handle->enable_input(enable);
+}
+
+
+void console_init(void)
+{
+	console_register("help", "list commands", console_help);
+	console_thread.start(console_loop);
+}
@@ -0,0 +1,54 @@
+/*
+ * console.h
+ *
+ *  Serial command console
+ *
+ *  Reads lines from stdin in a low priority thread, splits them into
+ *  arguments and calls the handler registered for the first word.
+ *
+ *      Author: sc lee
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#define CONSOLE_MAX_COMMANDS                    (16)
+#define CONSOLE_MAX_ARGS                        (6)
+#define CONSOLE_LINE_SIZE                       (64)
+
+/**
+ *
+ * Command handler, argv[0] is the command name
+ *
+ */
+typedef void (*console_handler_t)(int argc, char *argv[]);
+
+/**
+ *
+ * Start the console thread
+ *
+ */
+void console_init(void);
+
+/**
+ *
+ * Register a command, usually called before console_init(), from any thread
+ *
+ * @param name the command name
+ * @param help one line usage text shown by "help"
+ * @param handler the function called for the command
+ * @return 0 if success, -1 if the command table is full
+ *
+ */
+int console_register(const char *name, const char *help, console_handler_t handler);
+
+/**
+ *
+ * Enable or disable the serial receiver, the UART holds the device out
+ * of deep sleep while input is enabled
+ *
+ */
+void console_enable_input(bool enable);
+
+#endif /* CONSOLE_H_ */
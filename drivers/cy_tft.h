@@ -91,6 +91,16 @@ void cy_tft_write_command_stream(uint8_t data[], int num);
  */
 void cy_tft_write_data_stream(uint8_t data[], int num);
 
+/**
+ * Writes a pair of data bytes repeatedly to the software i8080 interface with
+ * the LCD_DC pin set to 1, e.g. one RGB565 pixel for a fill. Nothing is read
+ * from memory per byte, the fast path only toggles the changing pins.
+ * @param[in] first  The first byte of the pair
+ * @param[in] second The second byte of the pair
+ * @param[in] count  The number of pairs to send to the display
+ */
+void cy_tft_write_data_repeat(uint8_t first, uint8_t second, uint32_t count);
+
 /**
  * Reads one byte of data from the software i8080 interface with the LCD_DC pin
  * set to 1.
@@ -106,6 +116,29 @@ uint8_t cy_tft_read_data(void);
  */
 void cy_tft_read_data_stream(uint8_t data[], int num);
 
+/**
+ * Selects between the port-wide register writes and the per pin HAL writes
+ * of the data bus, the fast path is selected by cy_tft_io_init() when
+ * CY_TFT_FAST_IO is enabled.
+ * @param[in] enable true for the fast path
+ * @return true if the fast path is in use
+ */
+bool cy_tft_set_fast_io(bool enable);
+
+/**
+ * Enables the DMA transport of repeated pixel streams, available when built
+ * with CY_TFT_DMA and the fast path is in use. Streams wait for the DMA in
+ * cy_tft_dma_wait(), which an RTOS application can override together with
+ * cy_tft_dma_done(), called from the DMA interrupt, to block instead of spin.
+ * The channel is reserved with the HAL resource manager while in use, if
+ * another driver holds it the CPU path stays in use.
+ * @param[in] enable true for the DMA transport
+ * @return true if the DMA transport is in use
+ */
+bool cy_tft_set_dma(bool enable);
+void cy_tft_dma_wait(void);
+void cy_tft_dma_done(void);
+
 /**
  * Free all resources used for the software i8080 interface.
  * @return The byte read from the display
@@ -52,8 +52,14 @@ Purpose     : Display controller initialization
 */
 //
 // Define the available number of bytes available for the GUI
+// The memory devices of lcd_ui take up to about 11 KB at a time,
+// set emwin-numbytes of mbed_app.json to the size "lcd heap soak" recommends
 //
+#ifdef MBED_CONF_APP_EMWIN_NUMBYTES
+#define GUI_NUMBYTES  MBED_CONF_APP_EMWIN_NUMBYTES
+#else
 #define GUI_NUMBYTES  (1024*32)
+#endif
 
 /*********************************************************************
 *
@@ -84,4 +90,15 @@ void GUI_X_Config(void) {
   GUI_SetDefaultFont(GUI_FONT_6X8);
 }
 
+/*********************************************************************
+*
+*       GUI_X_GetNumBytes
+*
+* Purpose:
+*   Size of the memory assigned to emWin, for the heap statistics.
+*/
+U32 GUI_X_GetNumBytes(void) {
+  return GUI_NUMBYTES;
+}
+
 /*************************** End of file ****************************/
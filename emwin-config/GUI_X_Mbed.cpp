@@ -52,9 +52,10 @@ Purpose     : Config / System dependent externals for GUI
 *       Global data
 */
 
-Ticker emwin_ticker;
 Mutex emwin_mutex;
-volatile GUI_TIMER_TIME timeMS = 0;
+EventFlags emwin_events;
+
+#define EMWIN_EVENT_FLAG  (1u)
 
 /*********************************************************************
 *
@@ -71,16 +72,18 @@ volatile GUI_TIMER_TIME timeMS = 0;
   Some timing dependent routines require a GetTime
   and delay function. Default time unit (tick), normally is
   1 ms.
+
+  Both use the RTOS kernel tick, delays sleep the calling thread.
 */
 
 GUI_TIMER_TIME GUI_X_GetTime(void)
 {
-  return timeMS;
+  return (GUI_TIMER_TIME)Kernel::get_ms_count();
 }
 
 void GUI_X_Delay(int ms)
 {
-	wait_us(ms*1000);
+	ThisThread::sleep_for(ms);
 }
 
 /*********************************************************************
@@ -90,7 +93,7 @@ void GUI_X_Delay(int ms)
 */
 void GUI_X_ExecIdle(void)
 {
-	wait_us(1000);
+	ThisThread::sleep_for(1);
 }
 
 /*********************************************************************
@@ -108,12 +111,35 @@ void GUI_X_ExecIdle(void)
 *   thread using the emWin API.
 *   In this case the
 *                       #define GUI_OS 1
-*  needs to be in GUIConf.h
+*  needs to be in GUIConf.h, the EMWIN_OSNTS component of mbed_app.json
 */
 void GUI_X_InitOS(void)    {}
 void GUI_X_Unlock(void)    { emwin_mutex.unlock(); }
 void GUI_X_Lock(void)      { emwin_mutex.lock();  }
-U32  GUI_X_GetTaskId(void) { return 0; }
+U32  GUI_X_GetTaskId(void) { return (U32)ThisThread::get_id(); }
+
+/*********************************************************************
+*
+*      Event driving (optional with multitasking)
+*
+*                 GUI_X_WaitEvent()
+*                 GUI_X_WaitEventTimed()
+*                 GUI_X_SignalEvent()
+*/
+void GUI_X_WaitEvent(void)
+{
+  emwin_events.wait_any(EMWIN_EVENT_FLAG);
+}
+
+void GUI_X_WaitEventTimed(int Period)
+{
+  emwin_events.wait_any(EMWIN_EVENT_FLAG, Period);
+}
+
+void GUI_X_SignalEvent(void)
+{
+  emwin_events.set(EMWIN_EVENT_FLAG);
+}
 
 /*********************************************************************
 *
@@ -133,11 +159,6 @@ void GUI_X_Log     (const char *s) { printf("%s", s); }
 void GUI_X_Warn    (const char *s) { printf("%s", s); }
 void GUI_X_ErrorOut(const char *s) { printf("%s", s); }
 
-void ticker_handler(void)
-{
-    timeMS++;
-}
-
 /*********************************************************************
 *
 *      GUI_X_Init()
@@ -150,7 +171,6 @@ void ticker_handler(void)
 
 void GUI_X_Init(void)
 {
-    emwin_ticker.attach(&ticker_handler, 0.001);
 }
 
 /*************************** End of file ****************************/
@@ -42,6 +42,8 @@ Purpose     : Generic  configuration file for GUIDRV_FlexColor
 ---------------------------END-OF-HEADER------------------------------
 */
 
+#include <string.h>
+
 #include "GUI.h"
 #include "GUIDRV_FlexColor.h"
 
@@ -55,11 +57,25 @@ Purpose     : Generic  configuration file for GUIDRV_FlexColor
 *
 **********************************************************************
 */
+//
+// Orientation in the display controller (MADCTL), emWin then draws in the
+// raster order of the controller with long runs of pixels. With 0 emWin
+// rotates the coordinates in software as before.
+//
+#ifndef LCD_HW_ORIENTATION
+  #define LCD_HW_ORIENTATION 1
+#endif
+
 //
 // Physical display size
 //
-#define XSIZE_PHYS 240
-#define YSIZE_PHYS 320
+#if LCD_HW_ORIENTATION
+  #define XSIZE_PHYS 320
+  #define YSIZE_PHYS 240
+#else
+  #define XSIZE_PHYS 240
+  #define YSIZE_PHYS 320
+#endif
 
 //
 // Color conversion
@@ -74,6 +90,60 @@ Purpose     : Generic  configuration file for GUIDRV_FlexColor
 //
 #define DISPLAY_DRIVER GUIDRV_FLEXCOLOR
 
+//
+// Bytes written to the display bus, for the redraw statistics
+//
+static volatile U32 _BusBytes;
+
+//
+// Read back statistics, reads of the display RAM are the slowest bus
+// operation, every byte turns the data pins around twice
+//
+static volatile U32 _NumReads;
+static volatile U32 _ReadBusBytes;
+static volatile U32 _ReadShadowBytes;
+static volatile U32 _ReadMismatch;
+
+//
+// Shadow tiles of the display RAM, reads of windows held completely in
+// them do not go to the bus. Tiles are taken by reads, least recently
+// read first, and kept up to date by the pixel writes. Each tile costs
+// SHADOW_TILE_SIZE^2 * 2 + SHADOW_TILE_SIZE * 4 bytes of RAM.
+//
+#ifdef MBED_CONF_APP_EMWIN_SHADOW_TILES
+  #define SHADOW_TILES MBED_CONF_APP_EMWIN_SHADOW_TILES
+#else
+  #define SHADOW_TILES 0
+#endif
+
+#define SHADOW_TILE_SIZE 32
+#define SHADOW_GRID      ((320 + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE)
+
+//
+// ST7789 commands the shadow follows
+//
+#define CMD_MADCTL 0x36
+#define CMD_CASET  0x2A
+#define CMD_RASET  0x2B
+#define CMD_RAMWR  0x2C
+#define CMD_RAMRD  0x2E
+#define CMD_WRMEMC 0x3C
+#define CMD_RDMEMC 0x3E
+
+//
+// Memory read returns a dummy byte, then 3 bytes per pixel, 6 bits of
+// red, green and blue each in the upper bits
+//
+#define READ_DUMMY_BYTES 1
+#define READ_PIXEL_BYTES 3
+
+//
+// MADCTL of the rotations 0, 90, 180 and 270 degrees, 0 is the landscape
+// orientation of the kit
+//
+static const U8 _aMADCTL[4] = { 0xA0, 0x00, 0x60, 0xC0 };
+static int _Rotation;
+
 /*********************************************************************
 *
 *       Configuration checking
@@ -104,106 +174,732 @@ Purpose     : Generic  configuration file for GUIDRV_FlexColor
 
 
 
+#if SHADOW_TILES
+
+typedef struct {
+  int Slot;                                      // grid slot, -1 if free
+  U32 LastRead;
+  U32 aValid[SHADOW_TILE_SIZE];                  // bit x of row y, pixel known
+  U16 aPixel[SHADOW_TILE_SIZE * SHADOW_TILE_SIZE];
+} SHADOW_TILE;
+
+static SHADOW_TILE _aTile[SHADOW_TILES];
+static signed char _aTileOfSlot[SHADOW_GRID * SHADOW_GRID];
+static U32 _ReadClock;
+static int _Verify;
+
+//
+// Command stream state: the window, the next pixel of a memory write
+// or read and the byte within it
+//
+static U8  _Cmd;
+static int _ParamIndex;
+static U16 _aCol[2];
+static U16 _aRow[2];
+static U16 _x, _y;
+static int _ByteIndex;
+static U8  _aPixelByte[READ_PIXEL_BYTES];
+static int _ServeFromShadow;
+
+static SHADOW_TILE * _GetTile(int x, int y) {
+  int Index;
+
+  if ((x >= SHADOW_GRID * SHADOW_TILE_SIZE) || (y >= SHADOW_GRID * SHADOW_TILE_SIZE)) {
+    return NULL;
+  }
+  Index = _aTileOfSlot[(y / SHADOW_TILE_SIZE) * SHADOW_GRID + x / SHADOW_TILE_SIZE];
+  return (Index < 0) ? NULL : &_aTile[Index];
+}
+
+//
+// Take the least recently read tile for the slot of (x, y)
+//
+static SHADOW_TILE * _AllocTile(int x, int y) {
+  SHADOW_TILE * pTile;
+  int i;
+
+  pTile = _GetTile(x, y);
+  if (pTile || (x >= SHADOW_GRID * SHADOW_TILE_SIZE) || (y >= SHADOW_GRID * SHADOW_TILE_SIZE)) {
+    return pTile;
+  }
+  pTile = &_aTile[0];
+  for (i = 1; i < SHADOW_TILES; i++) {
+    if (_aTile[i].LastRead < pTile->LastRead) {
+      pTile = &_aTile[i];
+    }
+  }
+  if (pTile->Slot >= 0) {
+    _aTileOfSlot[pTile->Slot] = -1;
+  }
+  pTile->Slot = (y / SHADOW_TILE_SIZE) * SHADOW_GRID + x / SHADOW_TILE_SIZE;
+  memset(pTile->aValid, 0, sizeof(pTile->aValid));
+  _aTileOfSlot[pTile->Slot] = (signed char)(pTile - _aTile);
+  return pTile;
+}
+
+static void _SetPixel(SHADOW_TILE * pTile, int x, int y, U16 Pixel) {
+  x %= SHADOW_TILE_SIZE;
+  y %= SHADOW_TILE_SIZE;
+  pTile->aPixel[y * SHADOW_TILE_SIZE + x] = Pixel;
+  pTile->aValid[y] |= 1u << x;
+}
+
+//
+// Next pixel of the window, memory access wraps around to the start
+//
+static void _NextPixel(void) {
+  if (++_x > _aCol[1]) {
+    _x = _aCol[0];
+    if (++_y > _aRow[1]) {
+      _y = _aRow[0];
+    }
+  }
+}
+
+//
+// Is every pixel of the window in a shadow tile
+//
+static int _WindowInShadow(void) {
+  SHADOW_TILE * pTile;
+  U32 Mask;
+  int x, y, x1;
+
+  for (y = _aRow[0]; y <= _aRow[1]; y++) {
+    for (x = _aCol[0]; x <= _aCol[1]; x = x1 + 1) {
+      pTile = _GetTile(x, y);
+      if (!pTile) {
+        return 0;
+      }
+      x1 = (x | (SHADOW_TILE_SIZE - 1)) < _aCol[1] ? (x | (SHADOW_TILE_SIZE - 1)) : _aCol[1];
+      Mask = (x1 % SHADOW_TILE_SIZE == SHADOW_TILE_SIZE - 1) ? 0xFFFFFFFFu : ((1u << (x1 % SHADOW_TILE_SIZE + 1)) - 1);
+      Mask &= ~((1u << (x % SHADOW_TILE_SIZE)) - 1);
+      if ((pTile->aValid[y % SHADOW_TILE_SIZE] & Mask) != Mask) {
+        return 0;
+      }
+      pTile->LastRead = _ReadClock;
+    }
+  }
+  return 1;
+}
+
+static void _ShadowCommand(U8 Cmd) {
+  _Cmd = Cmd;
+  _ParamIndex = 0;
+  switch (Cmd) {
+  case CMD_RAMWR:
+  case CMD_RAMRD:
+    _x = _aCol[0];
+    _y = _aRow[0];
+    _ByteIndex = 0;
+    break;
+  case CMD_WRMEMC:
+    _Cmd = CMD_RAMWR;
+    break;
+  case CMD_RDMEMC:
+    _Cmd = CMD_RAMRD;
+    break;
+  }
+  if (_Cmd == CMD_RAMRD) {
+    _ReadClock++;
+    _ServeFromShadow = -1;                       // decided on the first read
+  }
+}
+
+static void _ShadowWrite(const U8 * pData, int NumItems) {
+  SHADOW_TILE * pTile;
+
+  for (; NumItems > 0; NumItems--, pData++) {
+    switch (_Cmd) {
+    case CMD_CASET:
+    case CMD_RASET:
+      if (_ParamIndex < 4) {
+        U16 * p = (_Cmd == CMD_CASET) ? _aCol : _aRow;
+        if (_ParamIndex & 1) {
+          p[_ParamIndex >> 1] |= *pData;
+        } else {
+          p[_ParamIndex >> 1] = (U16)(*pData << 8);
+        }
+      }
+      _ParamIndex++;
+      break;
+    case CMD_RAMWR:
+      if (_ByteIndex == 0) {
+        _aPixelByte[0] = *pData;
+        _ByteIndex = 1;
+        break;
+      }
+      _ByteIndex = 0;
+      pTile = _GetTile(_x, _y);
+      if (pTile) {
+        _SetPixel(pTile, _x, _y, (U16)((_aPixelByte[0] << 8) | *pData));
+      }
+      _NextPixel();
+      break;
+    }
+  }
+}
+
+//
+// The bytes the controller returns for the next read byte, from the tiles
+//
+static U8 _ShadowReadByte(void) {
+  SHADOW_TILE * pTile;
+  U16 Pixel;
+  U8 Data;
+  int Component;
+
+  if (_ByteIndex < READ_DUMMY_BYTES) {
+    _ByteIndex++;
+    return 0;
+  }
+  Component = (_ByteIndex - READ_DUMMY_BYTES) % READ_PIXEL_BYTES;
+  pTile = _GetTile(_x, _y);
+  Pixel = pTile ? pTile->aPixel[(_y % SHADOW_TILE_SIZE) * SHADOW_TILE_SIZE + _x % SHADOW_TILE_SIZE] : 0;
+  switch (Component) {
+  case 0:  Data = (U8)((Pixel >> 8) & 0xF8); break;
+  case 1:  Data = (U8)((Pixel >> 3) & 0xFC); break;
+  default: Data = (U8)((Pixel << 3) & 0xF8); break;
+  }
+  return Data;
+}
+
+//
+// Follow a read byte, store pixels read from the bus
+//
+static void _ShadowReadAdvance(U8 Data, int FromBus) {
+  SHADOW_TILE * pTile;
+  int Component;
+
+  if (_ByteIndex < READ_DUMMY_BYTES) {
+    return;
+  }
+  Component = (_ByteIndex - READ_DUMMY_BYTES) % READ_PIXEL_BYTES;
+  _aPixelByte[Component] = Data;
+  _ByteIndex++;
+  if (Component < READ_PIXEL_BYTES - 1) {
+    return;
+  }
+  if (FromBus) {
+    pTile = _AllocTile(_x, _y);
+    if (pTile) {
+      pTile->LastRead = _ReadClock;
+      _SetPixel(pTile, _x, _y, (U16)(((_aPixelByte[0] & 0xF8) << 8) | ((_aPixelByte[1] & 0xFC) << 3) | (_aPixelByte[2] >> 3)));
+    }
+  }
+  _NextPixel();
+}
+
+static void _ShadowRead(U8 * pData, int NumItems) {
+  U8 Data;
+  U8 Mask;
+
+  if (_Cmd != CMD_RAMRD) {
+    cy_tft_read_data_stream(pData, NumItems);
+    _ReadBusBytes += NumItems;
+    return;
+  }
+  if (_ServeFromShadow < 0) {
+    _ServeFromShadow = _WindowInShadow();
+  }
+  if (_ServeFromShadow && !_Verify) {
+    for (; NumItems > 0; NumItems--) {
+      int Dummy = (_ByteIndex < READ_DUMMY_BYTES);
+      *pData = _ShadowReadByte();
+      if (!Dummy) {
+        _ShadowReadAdvance(*pData, 0);
+      }
+      pData++;
+      _ReadShadowBytes++;
+    }
+    return;
+  }
+  cy_tft_read_data_stream(pData, NumItems);
+  _ReadBusBytes += NumItems;
+  for (; NumItems > 0; NumItems--, pData++) {
+    if (_ByteIndex < READ_DUMMY_BYTES) {
+      _ByteIndex++;
+      continue;
+    }
+    if (_ServeFromShadow) {
+      Data = _ShadowReadByte();
+      Mask = ((_ByteIndex - READ_DUMMY_BYTES) % READ_PIXEL_BYTES == 1) ? 0xFC : 0xF8;
+      if ((Data ^ *pData) & Mask) {
+        _ReadMismatch++;
+      }
+    }
+    _ShadowReadAdvance(*pData, !_ServeFromShadow);
+  }
+}
+
+//
+// A fill written around the pixel stream, into the tiles it covers
+//
+static void _ShadowFillRect(int x0, int y0, int x1, int y1, U16 Pixel) {
+  SHADOW_TILE * pTile;
+  int i, x, y, tx0, ty0, tx1, ty1;
+
+  for (i = 0; i < SHADOW_TILES; i++) {
+    pTile = &_aTile[i];
+    if (pTile->Slot < 0) {
+      continue;
+    }
+    tx0 = (pTile->Slot % SHADOW_GRID) * SHADOW_TILE_SIZE;
+    ty0 = (pTile->Slot / SHADOW_GRID) * SHADOW_TILE_SIZE;
+    tx1 = (tx0 + SHADOW_TILE_SIZE - 1 < x1) ? tx0 + SHADOW_TILE_SIZE - 1 : x1;
+    ty1 = (ty0 + SHADOW_TILE_SIZE - 1 < y1) ? ty0 + SHADOW_TILE_SIZE - 1 : y1;
+    tx0 = (tx0 > x0) ? tx0 : x0;
+    ty0 = (ty0 > y0) ? ty0 : y0;
+    for (y = ty0; y <= ty1; y++) {
+      for (x = tx0; x <= tx1; x++) {
+        _SetPixel(pTile, x, y, Pixel);
+      }
+    }
+  }
+}
+
+static void _ShadowInit(void) {
+  int i;
+
+  memset(_aTileOfSlot, -1, sizeof(_aTileOfSlot));
+  for (i = 0; i < SHADOW_TILES; i++) {
+    _aTile[i].Slot = -1;
+    _aTile[i].LastRead = 0;
+  }
+}
+
+#endif
+
 /********************************************************************
 *
-*       _InitController
+*       Port API with bus byte counting
+*/
+static void _Write8_A0(U8 Data) {
+  _BusBytes++;
+  if (Data == CMD_RAMRD) {
+    _NumReads++;
+  }
+#if SHADOW_TILES
+  _ShadowCommand(Data);
+#endif
+  cy_tft_write_command(Data);
+}
+
+static void _Write8_A1(U8 Data) {
+  _BusBytes++;
+#if SHADOW_TILES
+  _ShadowWrite(&Data, 1);
+#endif
+  cy_tft_write_data(Data);
+}
+
+static void _WriteM8_A1(U8 * pData, int NumItems) {
+  _BusBytes += NumItems;
+#if SHADOW_TILES
+  _ShadowWrite(pData, NumItems);
+#endif
+  cy_tft_write_data_stream(pData, NumItems);
+}
+
+static void _ReadM8_A1(U8 * pData, int NumItems) {
+#if SHADOW_TILES
+  _ShadowRead(pData, NumItems);
+#else
+  _ReadBusBytes += NumItems;
+  cy_tft_read_data_stream(pData, NumItems);
+#endif
+}
+
+static U8 _Read8_A1(void) {
+  U8 Data;
+
+  _ReadM8_A1(&Data, 1);
+  return Data;
+}
+
+U32 LCD_X_GetBusBytes(void) {
+  return _BusBytes;
+}
+
+/*********************************************************************
+*
+*       LCD_X_GetReadStat
+*
+* Purpose:
+*   Memory reads (RAMRD), bytes read from the bus and from the shadow
+*   tiles, and bytes of shadow hits which differed from the bus in
+*   verify mode.
+*/
+void LCD_X_GetReadStat(U32 * pNumReads, U32 * pBusBytes, U32 * pShadowBytes, U32 * pMismatch) {
+  *pNumReads    = _NumReads;
+  *pBusBytes    = _ReadBusBytes;
+  *pShadowBytes = _ReadShadowBytes;
+  *pMismatch    = _ReadMismatch;
+}
+
+/*********************************************************************
+*
+*       LCD_X_GetShadowTiles
+*/
+int LCD_X_GetShadowTiles(void) {
+  return SHADOW_TILES;
+}
+
+/*********************************************************************
+*
+*       LCD_X_SetShadowVerify
+*
+* Purpose:
+*   With verify on, shadow hits are read from the bus as well and
+*   compared, to check the read format of the controller.
+*/
+void LCD_X_SetShadowVerify(int OnOff) {
+#if SHADOW_TILES
+  _Verify = OnOff;
+#else
+  GUI_USE_PARA(OnOff);
+#endif
+}
+
+/*********************************************************************
+*
+*       LCD_X_InvalidateShadow
+*
+* Purpose:
+*   Drops the shadow tiles, after the display RAM was written around
+*   emWin.
+*/
+void LCD_X_InvalidateShadow(void) {
+#if SHADOW_TILES
+  _ShadowInit();
+#endif
+}
+
+/*********************************************************************
+*
+*       Solid fills
+*
+* The fill rectangle function of the driver is replaced, it sets the
+* window once and has the pixel repeated by cy_tft_write_data_repeat()
+* instead of streaming buffers of the same pixel. With _FillRepeat off
+* the buffered way is used, for comparison.
+*/
+#define FILL_BUFFER_PIXELS 32
+
+static int _FillRepeat = 1;
+
+static void _SetWindow(int x0, int y0, int x1, int y1) {
+  _Write8_A0(CMD_CASET);
+  _Write8_A1((U8)(x0 >> 8));
+  _Write8_A1((U8)x0);
+  _Write8_A1((U8)(x1 >> 8));
+  _Write8_A1((U8)x1);
+  _Write8_A0(CMD_RASET);
+  _Write8_A1((U8)(y0 >> 8));
+  _Write8_A1((U8)y0);
+  _Write8_A1((U8)(y1 >> 8));
+  _Write8_A1((U8)y1);
+}
+
+static void _FillRect(int LayerIndex, int x0, int y0, int x1, int y1, U32 PixelIndex) {
+  U8 aBuffer[FILL_BUFFER_PIXELS * 2];
+  U32 NumPixels;
+  U32 Num;
+  int x, y, i;
+  LCD_DRAWMODE DrawMode;
+
+  GUI_USE_PARA(LayerIndex);
+  //
+  // The mode is only read, the caller's mode is restored on every path
+  //
+  DrawMode = LCD_SetDrawMode(LCD_DRAWMODE_NORMAL);
+  LCD_SetDrawMode(DrawMode);
+  //
+  // XOR inverts what is on the display, pixel by pixel
+  //
+  if (DrawMode & LCD_DRAWMODE_XOR) {
+    for (y = y0; y <= y1; y++) {
+      for (x = x0; x <= x1; x++) {
+        LCD_SetPixelIndex(x, y, LCD_GetPixelIndex(x, y) ^ 0xFFFF);
+      }
+    }
+    return;
+  }
+  NumPixels = (U32)(x1 - x0 + 1) * (U32)(y1 - y0 + 1);
+  _SetWindow(x0, y0, x1, y1);
+  _Write8_A0(CMD_RAMWR);
+  if (_FillRepeat) {
+    _BusBytes += NumPixels * 2;
+#if SHADOW_TILES
+    _ShadowFillRect(x0, y0, x1, y1, (U16)PixelIndex);
+#endif
+    cy_tft_write_data_repeat((U8)(PixelIndex >> 8), (U8)PixelIndex, NumPixels);
+    return;
+  }
+  for (i = 0; i < FILL_BUFFER_PIXELS; i++) {
+    aBuffer[2 * i]     = (U8)(PixelIndex >> 8);
+    aBuffer[2 * i + 1] = (U8)PixelIndex;
+  }
+  for (; NumPixels; NumPixels -= Num) {
+    Num = (NumPixels < FILL_BUFFER_PIXELS) ? NumPixels : FILL_BUFFER_PIXELS;
+    _WriteM8_A1(aBuffer, (int)Num * 2);
+  }
+}
+
+/*********************************************************************
+*
+*       LCD_X_SetFillRepeat
+*
+* Purpose:
+*   Selects between the repeated pixel fill (default) and buffers of
+*   pixels, returns the previous setting.
+*/
+int LCD_X_SetFillRepeat(int OnOff) {
+  int Old = _FillRepeat;
+
+  _FillRepeat = OnOff;
+  return Old;
+}
+
+/*********************************************************************
+*
+*       LCD_X_SetRotation
 *
 * Purpose:
-*   Initializes the LCD controller
+*   Rotates the display in the controller, 0 to 3 for 0, 90, 180 and
+*   270 degrees, and sets the display size of emWin. To be called by
+*   the thread using emWin, the screen has to be redrawn.
+*
+* Return value:
+*   0 if done, -1 with software orientation or an invalid rotation.
+*/
+int LCD_X_SetRotation(int Rotation) {
+#if LCD_HW_ORIENTATION
+  int xSize, ySize;
+
+  if ((Rotation < 0) || (Rotation > 3)) {
+    return -1;
+  }
+  _Rotation = Rotation;
+  xSize = (Rotation & 1) ? YSIZE_PHYS : XSIZE_PHYS;
+  ySize = (Rotation & 1) ? XSIZE_PHYS : YSIZE_PHYS;
+  _Write8_A0(CMD_MADCTL);
+  _Write8_A1(_aMADCTL[Rotation]);
+  LCD_X_InvalidateShadow();
+  LCD_SetSizeEx (0, xSize, ySize);
+  LCD_SetVSizeEx(0, xSize, ySize);
+  //
+  // The clip rectangle still has the size of GUI_Init()
+  //
+  GUI_SetClipRect(NULL);
+  return 0;
+#else
+  GUI_USE_PARA(Rotation);
+  return -1;
+#endif
+}
+
+int LCD_X_GetRotation(void) {
+  return _Rotation;
+}
+
+/********************************************************************
+*
+*       Controller init tables
+*
+* Each command is: command, number of data bytes (INIT_DELAY set if a
+* delay in ms follows the data), data, delay. The data of a command go
+* out as one stream, delays sleep. MADCTL data are replaced by the
+* rotation in use.
+*/
+#define INIT_DELAY 0x80
+#define INIT_END   0x00
+
+static const U8 _aInit_ST7789V[] = {
+  0x28, 0,                                                     // DISPOFF
+  0x11, INIT_DELAY | 0, 100,                                   // SLPOUT: Exit Sleep mode
+  CMD_MADCTL, 1, 0xA0,                                         // MADCTL: memory data access control
+  0x3A, 1, 0x65,                                               // COLMOD: Interface Pixel format
+  0xB2, 5, 0x0C, 0x0C, 0x00, 0x33, 0x33,                       // PORCTRK: Porch setting
+  0xB7, 1, 0x35,                                               // GCTRL: Gate Control
+  0xBB, 1, 0x2B,                                               // VCOMS: VCOM setting
+  0xC0, 1, 0x2C,                                               // LCMCTRL: LCM Control
+  0xC2, 2, 0x01, 0xFF,                                         // VDVVRHEN: VDV and VRH Command Enable
+  0xC3, 1, 0x11,                                               // VRHS: VRH Set
+  0xC4, 1, 0x20,                                               // VDVS: VDV Set
+  0xC6, 1, 0x0F,                                               // FRCTRL2: Frame Rate control in normal mode
+  0xD0, 2, 0xA4, 0xA1,                                         // PWCTRL1: Power Control 1
+  0xE0, 14, 0xD0, 0x00, 0x05, 0x0E, 0x15, 0x0D, 0x37,
+            0x43, 0x47, 0x09, 0x15, 0x12, 0x16, 0x19,          // PVGAMCTRL: Positive Voltage Gamma control
+  0xE1, 14, 0xD0, 0x00, 0x05, 0x0D, 0x0C, 0x06, 0x2D,
+            0x44, 0x40, 0x0E, 0x1C, 0x18, 0x16, 0x19,          // NVGAMCTRL: Negative Voltage Gamma control
+  CMD_RASET, 4, 0x00, 0x00, 0x00, 0xEF,                        // Y address set
+  CMD_CASET, INIT_DELAY | 4, 0x00, 0x00, 0x01, 0x3F, 10,       // X address set
+  0x29, 0,                                                     // DISPON
+  INIT_END
+};
+
+//
+// The same with the datasheet minimum delays: commands 5 ms after SLPOUT,
+// nothing needed before DISPON
+//
+static const U8 _aInit_ST7789V_Fast[] = {
+  0x28, 0,
+  0x11, INIT_DELAY | 0, 5,
+  CMD_MADCTL, 1, 0xA0,
+  0x3A, 1, 0x65,
+  0xB2, 5, 0x0C, 0x0C, 0x00, 0x33, 0x33,
+  0xB7, 1, 0x35,
+  0xBB, 1, 0x2B,
+  0xC0, 1, 0x2C,
+  0xC2, 2, 0x01, 0xFF,
+  0xC3, 1, 0x11,
+  0xC4, 1, 0x20,
+  0xC6, 1, 0x0F,
+  0xD0, 2, 0xA4, 0xA1,
+  0xE0, 14, 0xD0, 0x00, 0x05, 0x0E, 0x15, 0x0D, 0x37,
+            0x43, 0x47, 0x09, 0x15, 0x12, 0x16, 0x19,
+  0xE1, 14, 0xD0, 0x00, 0x05, 0x0D, 0x0C, 0x06, 0x2D,
+            0x44, 0x40, 0x0E, 0x1C, 0x18, 0x16, 0x19,
+  CMD_RASET, 4, 0x00, 0x00, 0x00, 0xEF,
+  CMD_CASET, 4, 0x00, 0x00, 0x01, 0x3F,
+  0x29, 0,
+  INIT_END
+};
+
+//
+// Power on defaults of the controller, no panel tuning
+//
+static const U8 _aInit_ST7789_Default[] = {
+  0x28, 0,
+  0x11, INIT_DELAY | 0, 5,
+  CMD_MADCTL, 1, 0xA0,
+  0x3A, 1, 0x65,
+  CMD_RASET, 4, 0x00, 0x00, 0x00, 0xEF,
+  CMD_CASET, 4, 0x00, 0x00, 0x01, 0x3F,
+  0x29, 0,
+  INIT_END
+};
+
+typedef struct {
+  const char * pName;
+  U8           ResetLowMs;
+  U8           ResetWaitMs;                    // 120 ms if the controller may be out of sleep
+  const U8   * pTable;
+} INIT_VARIANT;
+
+static const INIT_VARIANT _aInitVariant[] = {
+  { "st7789v",      100, 50,  _aInit_ST7789V         },
+  { "st7789v-fast", 1,   120, _aInit_ST7789V_Fast    },
+  { "st7789",       1,   120, _aInit_ST7789_Default  },
+};
+
+#ifndef LCD_INIT_VARIANT
+  #define LCD_INIT_VARIANT 0
+#endif
+
+static int _InitVariant = LCD_INIT_VARIANT;
+static GUI_TIMER_TIME _InitStartTime;
+static GUI_TIMER_TIME _InitReadyTime;
+
+static void _RunInitTable(const U8 * pTable) {
+  U8 aData[16];
+  U8 Cmd, Num;
+  int i;
+
+  while ((Cmd = *pTable++) != INIT_END) {
+    Num = *pTable++;
+    cy_tft_write_command(Cmd);
+    for (i = 0; i < (Num & ~INIT_DELAY); i++) {
+      aData[i] = *pTable++;
+    }
+    if (Cmd == CMD_MADCTL) {
+      aData[0] = _aMADCTL[_Rotation];
+    }
+    if (Num & ~INIT_DELAY) {
+      cy_tft_write_data_stream(aData, Num & ~INIT_DELAY);
+    }
+    if (Num & INIT_DELAY) {
+      GUI_X_Delay(*pTable++);
+    }
+  }
+}
+
+/********************************************************************
+*
+*       _InitController
 *
 * Purpose:
-*   Initializes the display controller
+*   Resets the display controller and runs the init table of the
+*   selected variant
 */
 static void _InitController(void)
 {
-  /* Set up the display controller and put it into operation. If the
-  *  display controller is not initialized by any external routine
-  *  this needs to be adapted by the customer.
-  */
+  const INIT_VARIANT * pVariant = &_aInitVariant[_InitVariant];
 
-    /* Initialize display interface */
-    cy_tft_io_init();
+  _InitStartTime = GUI_X_GetTime();
+
+  /* Reset the display controller */
+  cy_tft_write_reset_pin(0u);
+  GUI_X_Delay(pVariant->ResetLowMs);
+  cy_tft_write_reset_pin(1u);
+  GUI_X_Delay(pVariant->ResetWaitMs);
 
-    /* Reset the display controller */
-    cy_tft_write_reset_pin(0u);
-    GUI_Delay(100);
-    cy_tft_write_reset_pin(1u);
-    GUI_Delay(50);
-
-    cy_tft_write_command(0x28);
-    cy_tft_write_command(0x11);    /* Exit Sleep mode */
-    GUI_Delay(100);
-    cy_tft_write_command(0x36);
-    cy_tft_write_data(0xA0);    /* MADCTL: memory data access control */
-    cy_tft_write_command(0x3A);
-    cy_tft_write_data(0x65);    /* COLMOD: Interface Pixel format */
-    cy_tft_write_command(0xB2);
-    cy_tft_write_data(0x0C);
-    cy_tft_write_data(0x0C);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0x33);
-    cy_tft_write_data(0x33);    /* PORCTRK: Porch setting */
-    cy_tft_write_command(0xB7);
-    cy_tft_write_data(0x35);    /* GCTRL: Gate Control */
-    cy_tft_write_command(0xBB);
-    cy_tft_write_data(0x2B);    /* VCOMS: VCOM setting */
-    cy_tft_write_command(0xC0);
-    cy_tft_write_data(0x2C);    /* LCMCTRL: LCM Control */
-    cy_tft_write_command(0xC2);
-    cy_tft_write_data(0x01);
-    cy_tft_write_data(0xFF);    /* VDVVRHEN: VDV and VRH Command Enable */
-    cy_tft_write_command(0xC3);
-    cy_tft_write_data(0x11);    /* VRHS: VRH Set */
-    cy_tft_write_command(0xC4);
-    cy_tft_write_data(0x20);    /* VDVS: VDV Set */
-    cy_tft_write_command(0xC6);
-    cy_tft_write_data(0x0F);    /* FRCTRL2: Frame Rate control in normal mode */
-    cy_tft_write_command(0xD0);
-    cy_tft_write_data(0xA4);
-    cy_tft_write_data(0xA1);    /* PWCTRL1: Power Control 1 */
-    cy_tft_write_command(0xE0);
-    cy_tft_write_data(0xD0);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0x05);
-    cy_tft_write_data(0x0E);
-    cy_tft_write_data(0x15);
-    cy_tft_write_data(0x0D);
-    cy_tft_write_data(0x37);
-    cy_tft_write_data(0x43);
-    cy_tft_write_data(0x47);
-    cy_tft_write_data(0x09);
-    cy_tft_write_data(0x15);
-    cy_tft_write_data(0x12);
-    cy_tft_write_data(0x16);
-    cy_tft_write_data(0x19);    /* PVGAMCTRL: Positive Voltage Gamma control */
-    cy_tft_write_command(0xE1);
-    cy_tft_write_data(0xD0);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0x05);
-    cy_tft_write_data(0x0D);
-    cy_tft_write_data(0x0C);
-    cy_tft_write_data(0x06);
-    cy_tft_write_data(0x2D);
-    cy_tft_write_data(0x44);
-    cy_tft_write_data(0x40);
-    cy_tft_write_data(0x0E);
-    cy_tft_write_data(0x1C);
-    cy_tft_write_data(0x18);
-    cy_tft_write_data(0x16);
-    cy_tft_write_data(0x19);    /* NVGAMCTRL: Negative Voltage Gamma control */
-    cy_tft_write_command(0x2B);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0xEF);    /* Y address set */
-    cy_tft_write_command(0x2A);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0x00);
-    cy_tft_write_data(0x01);
-    cy_tft_write_data(0x3F);    /* X address set */
-    GUI_Delay(10);
-    cy_tft_write_command(0x29);
+  _RunInitTable(pVariant->pTable);
+  LCD_X_InvalidateShadow();
 
+  _InitReadyTime = GUI_X_GetTime();
+}
+
+/*********************************************************************
+*
+*       LCD_X_SetInitVariant
+*
+* Purpose:
+*   Selects the init table by name and runs it again, to be called by
+*   the thread using emWin, the screen has to be redrawn.
+*
+* Return value:
+*   0 if done, -1 for an unknown name.
+*/
+int LCD_X_SetInitVariant(const char * pName) {
+  unsigned i;
+
+  for (i = 0; i < GUI_COUNTOF(_aInitVariant); i++) {
+    if (strcmp(pName, _aInitVariant[i].pName) == 0) {
+      _InitVariant = (int)i;
+      _InitController();
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*********************************************************************
+*
+*       LCD_X_GetInitVariant
+*
+* Purpose:
+*   Name of the init variant Index, NULL past the last one.
+*/
+const char * LCD_X_GetInitVariant(int Index) {
+  if ((Index < 0) || (Index >= (int)GUI_COUNTOF(_aInitVariant))) {
+    return NULL;
+  }
+  return _aInitVariant[Index].pName;
+}
+
+/*********************************************************************
+*
+*       LCD_X_GetInitTime
+*
+* Purpose:
+*   Time of the last controller init and when the display was ready,
+*   in ms of GUI_X_GetTime(), since boot.
+*/
+void LCD_X_GetInitTime(U32 * pStart, U32 * pReady, int * pVariant) {
+  *pStart   = (U32)_InitStartTime;
+  *pReady   = (U32)_InitReadyTime;
+  *pVariant = _InitVariant;
 }
 
 /*********************************************************************
@@ -238,22 +934,32 @@ void LCD_X_Config(void)
   //
   // Orientation
   //
+#if LCD_HW_ORIENTATION
+  Config.Orientation   = 0;
+#else
   Config.Orientation   = GUI_MIRROR_Y | GUI_SWAP_XY;
+#endif
   GUIDRV_FlexColor_Config(pDevice, &Config);
   //
   // Set controller and operation mode
   //
 
 
-  	 PortAPI.pfWrite8_A0  = cy_tft_write_command;
-     PortAPI.pfWrite8_A1  = cy_tft_write_data;
-     PortAPI.pfWriteM8_A1 = cy_tft_write_data_stream;
-     PortAPI.pfRead8_A1   = cy_tft_read_data;
-     PortAPI.pfReadM8_A1  = cy_tft_read_data_stream;
+  	 PortAPI.pfWrite8_A0  = _Write8_A0;
+     PortAPI.pfWrite8_A1  = _Write8_A1;
+     PortAPI.pfWriteM8_A1 = _WriteM8_A1;
+     PortAPI.pfRead8_A1   = _Read8_A1;
+     PortAPI.pfReadM8_A1  = _ReadM8_A1;
 
 
 
   GUIDRV_FlexColor_SetFunc(pDevice, &PortAPI, GUIDRV_FLEXCOLOR_F66709, GUIDRV_FLEXCOLOR_M16C0B8);
+#if LCD_HW_ORIENTATION
+  //
+  // Fills in controller coordinates, as emWin gives them without rotation
+  //
+  LCD_SetDevFunc(0, LCD_DEVFUNC_FILLRECT, (void (*)(void))_FillRect);
+#endif
 
 
 }
@@ -296,6 +1002,7 @@ int LCD_X_DisplayDriver(unsigned LayerIndex, unsigned Cmd, void * pData)
     // to be adapted by the customer...
     //
     // ...
+    cy_tft_io_init();
     _InitController();
     r = 0;
     break;
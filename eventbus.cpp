@@ -0,0 +1,323 @@
+/*
+ * eventbus.cpp
+ *
+ *  Publish/subscribe event bus, see eventbus.h
+ *
+ *      Author: sc lee
+ *
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#include "eventbus.h"
+
+#include "mbed_atomic.h"
+#include "perf.h"
+#include "console.h"
+
+#include <string.h>
+
+
+#define EVENTBUS_RING_MASK                      (EVENTBUS_RING_SIZE - 1u)
+
+#if (EVENTBUS_RING_SIZE & EVENTBUS_RING_MASK) != 0
+#error EVENTBUS_RING_SIZE must be power of 2
+#endif
+
+#define EVENTBUS_FLAG_PUBLISHED                 (1u)
+
+/* A drain call which did not fit the subscriber's queue is posted again after */
+#define EVENTBUS_POST_RETRY_MS                  (10u)
+
+
+/*
+ * seq is the publish number + 1 of the event held, 0 while it is written.
+ * Readers copy the event and accept it only if seq did not change.
+ */
+typedef struct {
+	volatile uint32_t seq;
+	app_event_t event;
+} eventbus_slot_t;
+
+
+/* The bus has one, "bus bench" another so the subscribers see nothing of it */
+typedef struct {
+	eventbus_slot_t slots[EVENTBUS_RING_SIZE];
+	eventbus_slot_t latest[EVENT_TYPE_COUNT][EVENTBUS_MAX_IDS];
+	volatile uint32_t head;
+} eventbus_ring_t;
+
+
+static eventbus_ring_t eventbus_ring;
+
+static eventbus_subscriber_t *eventbus_subs[EVENTBUS_MAX_SUBSCRIBERS];
+static Mutex eventbus_subs_mutex;
+
+EventFlags eventbus_flags;
+Thread eventbus_thread(osPriorityNormal, 768, NULL, "eventbus_thread");
+
+
+
+static void eventbus_slot_write(eventbus_slot_t *slot, const app_event_t *event, uint32_t seq)
+{
+	core_util_atomic_store_u32(&slot->seq, 0);
+	slot->event = *event;
+	core_util_atomic_store_u32(&slot->seq, seq);
+}
+
+static bool eventbus_slot_read(eventbus_slot_t *slot, app_event_t *event, uint32_t *seq)
+{
+	uint32_t before = core_util_atomic_load_u32(&slot->seq);
+
+	if (!before)
+		return false;
+
+	*event = slot->event;
+
+	if (core_util_atomic_load_u32(&slot->seq) != before)
+		return false;
+
+	*seq = before;
+	return true;
+}
+
+
+void eventbus_publish(uint8_t type, uint8_t id, int32_t value)
+{
+	eventbus_publish_origin(type, id, value, 0);
+}
+
+static void eventbus_ring_publish(eventbus_ring_t *ring, uint8_t type, uint8_t id, int32_t value, uint32_t origin)
+{
+	uint32_t now = perf_cycles();
+	app_event_t event = { type, id, 0, value, now, origin ? origin : now };
+	uint32_t seq = core_util_atomic_fetch_add_u32(&ring->head, 1) + 1;
+
+	eventbus_slot_write(&ring->slots[(seq - 1) & EVENTBUS_RING_MASK], &event, seq);
+
+	if (type < EVENT_TYPE_COUNT && id < EVENTBUS_MAX_IDS)
+		eventbus_slot_write(&ring->latest[type][id], &event, seq);
+}
+
+void eventbus_publish_origin(uint8_t type, uint8_t id, int32_t value, uint32_t origin)
+{
+	eventbus_ring_publish(&eventbus_ring, type, id, value, origin);
+	eventbus_flags.set(EVENTBUS_FLAG_PUBLISHED);
+}
+
+
+static int eventbus_ring_poll(eventbus_ring_t *ring, eventbus_subscriber_t *sub)
+{
+	uint32_t head = core_util_atomic_load_u32(&ring->head);
+	uint32_t ring_mask = sub->type_mask & ~sub->coalesce_mask;
+	uint32_t coalesce_mask = sub->type_mask & sub->coalesce_mask;
+	int delivered = 0;
+	app_event_t event;
+	uint32_t seq;
+
+	if (head - sub->cursor > EVENTBUS_RING_SIZE) {
+		sub->dropped += head - sub->cursor - EVENTBUS_RING_SIZE;
+		sub->cursor = head - EVENTBUS_RING_SIZE;
+	}
+
+	while (sub->cursor != head) {
+		if (!eventbus_slot_read(&ring->slots[sub->cursor & EVENTBUS_RING_MASK], &event, &seq))
+			break;
+
+		/* Not written yet, try again on the next poll */
+		if (seq < sub->cursor + 1)
+			break;
+
+		/* Overwritten by a later lap */
+		if (seq > sub->cursor + 1) {
+			sub->dropped++;
+			sub->cursor++;
+			continue;
+		}
+
+		sub->cursor++;
+
+		if (ring_mask & EVENTBUS_TYPE(event.type)) {
+			sub->handler(&event);
+			delivered++;
+		}
+	}
+
+	for (uint32_t type = 0; coalesce_mask && type < EVENT_TYPE_COUNT; type++) {
+		if (!(coalesce_mask & EVENTBUS_TYPE(type)))
+			continue;
+
+		for (int id = 0; id < EVENTBUS_MAX_IDS; id++) {
+			if (!eventbus_slot_read(&ring->latest[type][id], &event, &seq) || seq == sub->seen[type][id])
+				continue;
+
+			sub->seen[type][id] = seq;
+			sub->handler(&event);
+			delivered++;
+		}
+	}
+
+	sub->delivered += delivered;
+	return delivered;
+}
+
+int eventbus_poll(eventbus_subscriber_t *sub)
+{
+	return eventbus_ring_poll(&eventbus_ring, sub);
+}
+
+
+static void eventbus_drain(eventbus_subscriber_t *sub)
+{
+	core_util_atomic_store_bool(&sub->posted, false);
+	eventbus_poll(sub);
+}
+
+static void eventbus_dispatch(void)
+{
+	bool retry = false;
+
+	while (true) {
+		eventbus_flags.wait_any(EVENTBUS_FLAG_PUBLISHED, retry ? EVENTBUS_POST_RETRY_MS : osWaitForever);
+		retry = false;
+
+		eventbus_subs_mutex.lock();
+		for (int i = 0; i < EVENTBUS_MAX_SUBSCRIBERS; i++) {
+			eventbus_subscriber_t *sub = eventbus_subs[i];
+
+			if (!sub || !sub->queue)
+				continue;
+
+			/* at most one drain call pending per subscriber */
+			if (core_util_atomic_exchange_bool(&sub->posted, true))
+				continue;
+
+			/* queue full, the events wait in the ring for the retry */
+			if (!sub->queue->call(eventbus_drain, sub)) {
+				core_util_atomic_store_bool(&sub->posted, false);
+				sub->post_failed++;
+				retry = true;
+			}
+		}
+		eventbus_subs_mutex.unlock();
+	}
+}
+
+
+int eventbus_subscribe(eventbus_subscriber_t *sub, uint32_t type_mask, uint32_t coalesce_mask,
+		eventbus_handler_t handler, EventQueue *queue)
+{
+	int result = -1;
+
+	memset(sub, 0, sizeof(eventbus_subscriber_t));
+	sub->type_mask = type_mask;
+	sub->coalesce_mask = coalesce_mask;
+	sub->handler = handler;
+	sub->queue = queue;
+	sub->cursor = core_util_atomic_load_u32(&eventbus_ring.head);
+
+	eventbus_subs_mutex.lock();
+	for (int i = 0; i < EVENTBUS_MAX_SUBSCRIBERS; i++) {
+		if (!eventbus_subs[i]) {
+			eventbus_subs[i] = sub;
+			result = 0;
+			break;
+		}
+	}
+	eventbus_subs_mutex.unlock();
+
+	return result;
+}
+
+void eventbus_unsubscribe(eventbus_subscriber_t *sub)
+{
+	eventbus_subs_mutex.lock();
+	for (int i = 0; i < EVENTBUS_MAX_SUBSCRIBERS; i++) {
+		if (eventbus_subs[i] == sub)
+			eventbus_subs[i] = NULL;
+	}
+	eventbus_subs_mutex.unlock();
+}
+
+
+/*
+ * "bus bench": publish cost and per subscriber drain cost with 1 to 8
+ * polling subscribers, on a ring of its own so the application subscribers
+ * are neither overrun nor woken.
+ */
+#define EVENTBUS_BENCH_EVENTS                   (1024)
+#define EVENTBUS_BENCH_MAX_SUBS                 (8)
+
+static void eventbus_bench_handler(const app_event_t *event)
+{
+}
+
+static void eventbus_bench(void)
+{
+	static eventbus_ring_t ring;
+	static eventbus_subscriber_t subs[EVENTBUS_BENCH_MAX_SUBS];
+
+	for (int nsubs = 1; nsubs <= EVENTBUS_BENCH_MAX_SUBS; nsubs++) {
+		perf_stat_t publish_stat;
+		perf_stat_t drain_stat;
+		uint32_t dropped = 0;
+
+		perf_stat_reset(&publish_stat);
+		perf_stat_reset(&drain_stat);
+
+		/* not in the subscriber table, the bus thread never drains them */
+		memset(&ring, 0, sizeof(ring));
+		for (int i = 0; i < nsubs; i++) {
+			memset(&subs[i], 0, sizeof(eventbus_subscriber_t));
+			subs[i].type_mask = EVENTBUS_TYPE(EVENT_BENCH);
+			subs[i].handler = eventbus_bench_handler;
+		}
+
+		for (int n = 0; n < EVENTBUS_BENCH_EVENTS; n++) {
+			uint32_t start = perf_cycles();
+			eventbus_ring_publish(&ring, EVENT_BENCH, 0, n, 0);
+			perf_stat_add(&publish_stat, perf_cycles() - start);
+
+			/* drain twice per ring lap so nothing is dropped */
+			if ((n & (EVENTBUS_RING_SIZE / 2 - 1)) == EVENTBUS_RING_SIZE / 2 - 1) {
+				for (int i = 0; i < nsubs; i++) {
+					start = perf_cycles();
+					eventbus_ring_poll(&ring, &subs[i]);
+					perf_stat_add(&drain_stat, perf_cycles() - start);
+				}
+			}
+		}
+
+		for (int i = 0; i < nsubs; i++)
+			dropped += subs[i].dropped;
+
+		printf("subscribers: %d publish avg: %lu max: %lu cycles, drain of %u events avg: %lu cycles, dropped: %lu\n",
+				nsubs, publish_stat.count ? (uint32_t)(publish_stat.sum / publish_stat.count) : 0u, publish_stat.max,
+				EVENTBUS_RING_SIZE / 2, drain_stat.count ? (uint32_t)(drain_stat.sum / drain_stat.count) : 0u, dropped);
+	}
+}
+
+static void eventbus_cmd(int argc, char *argv[])
+{
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		eventbus_bench();
+		return;
+	}
+
+	eventbus_subs_mutex.lock();
+	printf("published: %lu\n", core_util_atomic_load_u32(&eventbus_ring.head));
+	for (int i = 0; i < EVENTBUS_MAX_SUBSCRIBERS; i++) {
+		if (eventbus_subs[i])
+			printf("subscriber %d types: %lx coalesced: %lx delivered: %lu dropped: %lu post failed: %lu\n", i,
+					eventbus_subs[i]->type_mask, eventbus_subs[i]->coalesce_mask,
+					eventbus_subs[i]->delivered, eventbus_subs[i]->dropped, eventbus_subs[i]->post_failed);
+	}
+	eventbus_subs_mutex.unlock();
+}
+
+
+void eventbus_init(void)
+{
+	perf_init();
+	console_register("bus", "stat|bench, event bus subscribers", eventbus_cmd);
+	eventbus_thread.start(eventbus_dispatch);
+}
@@ -0,0 +1,137 @@
+/*
+ * eventbus.h
+ *
+ *  Publish/subscribe event bus
+ *
+ *  Events are fixed size and go into one lock-free broadcast ring, every
+ *  subscriber reads it through its own cursor, so publishing costs the same
+ *  whatever the number of subscribers. A slow subscriber never blocks the
+ *  producer, it loses the oldest events and counts them as dropped.
+ *
+ *  A subscriber may declare types as coalesced. Those are not read from the
+ *  ring, only the latest event of every (type, id) is delivered, which can
+ *  not be lost by overrun.
+ *
+ *  Subscribers either call eventbus_poll() on their own schedule, or give
+ *  an EventQueue and the bus thread posts one drain call to it whenever
+ *  something was published.
+ *
+ *  Each (type, id) must have a single producer.
+ *
+ *      Author: sc lee
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef EVENTBUS_H_
+#define EVENTBUS_H_
+
+#include "mbed.h"
+
+/* Number of events of the ring, must be power of 2 */
+#ifndef EVENTBUS_RING_SIZE
+#define EVENTBUS_RING_SIZE                      (32u)
+#endif
+
+#define EVENTBUS_MAX_SUBSCRIBERS                (12)
+
+/* Number of ids per type kept for coalescing */
+#define EVENTBUS_MAX_IDS                        (4)
+
+#define EVENTBUS_TYPE(type)                     (1u << (type))
+
+
+typedef enum {
+	EVENT_BUTTON,                           /* id: button, value: 1 touched, 0 released */
+	EVENT_SLIDER,                           /* id: slider, value: position */
+	EVENT_LINK,                             /* id: 0, value: 1 network up with an address, 0 down */
+	EVENT_BENCH,                            /* used by "bus bench" only */
+	EVENT_TYPE_COUNT
+} event_type_t;
+
+typedef struct {
+	uint8_t type;
+	uint8_t id;
+	uint16_t reserved;
+	int32_t value;
+	uint32_t timestamp;                     /* perf_cycles() at publish */
+	uint32_t origin;                        /* perf_cycles() at the source, e.g. end of scan */
+} app_event_t;
+
+typedef void (*eventbus_handler_t)(const app_event_t *event);
+
+typedef struct {
+	uint32_t type_mask;
+	uint32_t coalesce_mask;
+	eventbus_handler_t handler;
+	EventQueue *queue;
+	uint32_t cursor;
+	uint32_t seen[EVENT_TYPE_COUNT][EVENTBUS_MAX_IDS];
+	volatile bool posted;
+	uint32_t delivered;
+	uint32_t dropped;
+	uint32_t post_failed;                   /* drain calls the queue had no room for */
+} eventbus_subscriber_t;
+
+
+/**
+ *
+ * Start the bus thread
+ *
+ */
+void eventbus_init(void);
+
+/**
+ *
+ * Publish an event, safe from any thread or interrupt
+ *
+ * @param type the event type
+ * @param id the source of the event, e.g. button number
+ * @param value the payload
+ *
+ */
+void eventbus_publish(uint8_t type, uint8_t id, int32_t value);
+
+/**
+ *
+ * Publish an event which happened before, for latency measurements
+ *
+ * @param type the event type
+ * @param id the source of the event, e.g. button number
+ * @param value the payload
+ * @param origin perf_cycles() when the source saw it, 0 for the publish time
+ *
+ */
+void eventbus_publish_origin(uint8_t type, uint8_t id, int32_t value, uint32_t origin);
+
+/**
+ *
+ * Add a subscriber
+ *
+ * @param sub subscriber storage, owned by the caller
+ * @param type_mask EVENTBUS_TYPE() of the wanted types
+ * @param coalesce_mask EVENTBUS_TYPE() of types delivered latest value only
+ * @param handler called for each event in the thread draining the subscriber
+ * @param queue queue to drain the subscriber on, NULL for eventbus_poll()
+ * @return 0 if success, -1 if there are too many subscribers
+ *
+ */
+int eventbus_subscribe(eventbus_subscriber_t *sub, uint32_t type_mask, uint32_t coalesce_mask,
+		eventbus_handler_t handler, EventQueue *queue);
+
+/**
+ *
+ * Remove a subscriber
+ *
+ */
+void eventbus_unsubscribe(eventbus_subscriber_t *sub);
+
+/**
+ *
+ * Deliver pending events of the subscriber to its handler
+ *
+ * @return number of delivered events
+ *
+ */
+int eventbus_poll(eventbus_subscriber_t *sub);
+
+#endif /* EVENTBUS_H_ */
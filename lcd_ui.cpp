@@ -10,47 +10,582 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
 
 #include "lcd_ui.h"
 #include "mbed.h"
+#include "cy8ckit_028_tft.h"
+#include "eventbus.h"
+#include "console.h"
+#include "mbed_stats.h"
+#include "perf.h"
+#include "us_ticker_api.h"
+#include "mbed_atomic.h"
+#include "applog.h"
+#include "boot.h"
+
+/* ST7789 commands */
+#define LCD_CMD_SLPIN                           (0x10)
+#define LCD_CMD_SLPOUT                          (0x11)
+#define LCD_CMD_DISPOFF                         (0x28)
+#define LCD_CMD_DISPON                          (0x29)
+#define LCD_CMD_IDMOFF                          (0x38)
+#define LCD_CMD_IDMON                           (0x39)
+#define LCD_CMD_WRDISBV                         (0x51)
+#define LCD_CMD_WRCTRLD                         (0x53)
+
+/* Sleep out needs 5 ms before the next command */
+#define LCD_SLPOUT_DELAY_MS                     (5)
+
+/* and 120 ms between sleep in and sleep out either way */
+#define LCD_SLEEP_SETTLE_MS                     (120)
+
+U32 LCD_X_GetBusBytes(void);
+U32 GUI_X_GetNumBytes(void);
+void LCD_X_GetReadStat(U32 *pNumReads,U32 *pBusBytes,U32 *pShadowBytes,U32 *pMismatch);
+int LCD_X_GetShadowTiles(void);
+void LCD_X_SetShadowVerify(int OnOff);
+void LCD_X_InvalidateShadow(void);
+int LCD_X_SetRotation(int Rotation);
+int LCD_X_GetRotation(void);
+int LCD_X_SetFillRepeat(int OnOff);
+int LCD_X_SetInitVariant(const char *pName);
+const char *LCD_X_GetInitVariant(int Index);
+void LCD_X_GetInitTime(U32 *pStart,U32 *pReady,int *pVariant);
 
 EventQueue lcd_queue(16 * EVENTS_EVENT_SIZE);
-Thread lcd_thread( osPriorityAboveNormal,2048,NULL,"lcd_thread");
 
+/* Below the CapSense scan thread, drawing must never delay touch processing */
+Thread lcd_thread( osPriorityBelowNormal,2048,NULL,"lcd_thread");
 
+/* Slider moves are coalesced, only the latest position is drawn */
+eventbus_subscriber_t lcd_subscriber;
 
-void lcd_draw_text_thread(const char *text,int line){
-	   GUI_SetFont(&GUI_Font24_1);
-	   //GUI_SetPenSize(10);
+/*
+ * Retained UI state. Producers only update it and set dirty bits, the
+ * lcd thread draws the latest state of the dirty elements in one render
+ * call, at most one render call is queued. The render call is scheduled
+ * on the next frame boundary, so there is no frame while nothing is dirty.
+ */
+#define LCD_BUTTONS                             (2)
 
+#define LCD_BUTTON_Y                            (200)
+#define LCD_BUTTON_R                            (25)
 
+/* Slider thumb and the part of the track it can cover */
+#define LCD_SLIDER_Y                            (145)
+#define LCD_SLIDER_DX                           (5)
+#define LCD_SLIDER_DY                           (20)
+#define LCD_SLIDER_X0                           (30)
+#define LCD_SLIDER_X1                           (290)
 
+#define LCD_DIRTY_BUTTON(id)                    (1u << (id))
+#define LCD_DIRTY_SLIDER                        (1u << 4)
+#define LCD_DIRTY_CONSOLE                       (1u << 8)
 
-	   GUI_RECT Rect = {20,50+line*30,300,50+(line+1)*30};
+/*
+ * Console rows on the panel above the slider. The ST7789 vertical scroll
+ * runs along the panel columns in landscape, so a scroll redraws the rows
+ * whose text changed instead.
+ */
+#ifndef LCD_CONSOLE_FONT
+#define LCD_CONSOLE_FONT                        GUI_Font16_1
+#endif
+
+#define LCD_CONSOLE_X0                          (24)
+#define LCD_CONSOLE_X1                          (296)
+#define LCD_CONSOLE_Y0                          (50)
+#define LCD_CONSOLE_ROW_H                       (18)
+
+/* Room for the repeat count of a line */
+#define LCD_CONSOLE_ROW_MAX                     (LCD_CONSOLE_COLS + 12)
+
+typedef struct {
+	char text[LCD_CONSOLE_COLS];
+	uint32_t repeat;
+} lcd_console_line_t;
+
+typedef struct {
+	int button[LCD_BUTTONS];
+	int slider_pos;
+	lcd_console_line_t console[LCD_CONSOLE_LINES];
+	uint32_t console_count;                 /* lines written, the latest is console_count - 1 */
+	uint32_t console_shown;                 /* console_count of the last frame */
+} lcd_state_t;
+
+typedef struct {
+	uint32_t renders;
+	uint32_t buttons;
+	uint32_t sliders;
+	uint32_t rows;
+	uint32_t rows_unchanged;
+	uint32_t button_bytes;
+	uint32_t slider_bytes;
+	uint32_t button_reads;
+	uint32_t slider_reads;
+	uint32_t row_reads;
+	uint32_t memdev_failed;
+	uint32_t console_unshown;
+} lcd_render_stat_t;
+
+lcd_state_t lcd_state = { {0, 0}, LCD_SLIDER_START_POS };
+uint32_t lcd_dirty = 0;
+bool lcd_render_posted = false;
+bool lcd_ready = false;
+Mutex lcd_state_mutex;
+
+/* Set once the startup drew the first frame */
+#define LCD_READY_FLAG                          (1u)
+EventFlags lcd_ready_flags;
+
+lcd_render_stat_t lcd_render_stat;
+
+/* Text of the console rows on the display, only rows that differ are drawn */
+char lcd_console_drawn[LCD_CONSOLE_ROWS][LCD_CONSOLE_ROW_MAX];
+bool lcd_console_valid = false;
+
+uint32_t lcd_frame_ms = 1000 / LCD_FPS;
+uint64_t lcd_frame_next_ms = 0;
+
+/* render time of a frame, frames longer than lcd_frame_ms miss the following ones */
+perf_stat_t lcd_frame_stat;
+uint32_t lcd_frame_missed = 0;
+uint64_t lcd_frame_busy_us = 0;
+uint64_t lcd_stat_last_busy_us = 0;
+
+/* last "lcd stat" for the rates */
+lcd_render_stat_t lcd_stat_last;
+uint32_t lcd_stat_last_bytes = 0;
+uint64_t lcd_stat_last_ms = 0;
+
+void lcd_render();
+
+/* Display memory reads by emWin so far, each costs a bus turnaround */
+uint32_t lcd_read_count(){
+	U32 reads,bus,shadow,mismatch;
+
+	LCD_X_GetReadStat(&reads,&bus,&shadow,&mismatch);
+	return reads;
+}
+
+/*
+ * Touch to display latency per element, "lcd latency". An event carries
+ * the CapSense end of scan and its publish time, the handler adds the time
+ * the lcd thread took it and the render the start and the end of the pixel
+ * writes of the element. The oldest undrawn change of an element is
+ * measured, later changes before the render are drawn along with it.
+ */
+#define LCD_LATENCY_SLIDER                      (LCD_BUTTONS)
+#define LCD_LATENCY_ELEMENTS                    (LCD_BUTTONS + 1)
+
+enum {
+	LCD_LATENCY_SCAN,                       /* end of scan to publish */
+	LCD_LATENCY_DISPATCH,                   /* publish to the lcd thread handler */
+	LCD_LATENCY_QUEUED,                     /* handler to the draw of the element */
+	LCD_LATENCY_RENDER,                     /* draw of the element until the last pixel write */
+	LCD_LATENCY_TOTAL,                      /* end of scan to the last pixel write */
+	LCD_LATENCY_STAGES
+};
+
+const char *lcd_latency_element_names[]={ "button0", "button1", "slider" };
+const char *lcd_latency_stage_names[]={ "scan", "dispatch", "queued", "render", "total" };
+
+typedef struct {
+	bool valid;
+	uint32_t origin;
+	uint32_t published;
+	uint32_t handled;
+} lcd_latency_mark_t;
+
+/* under lcd_state_mutex */
+lcd_latency_mark_t lcd_latency_mark[LCD_LATENCY_ELEMENTS];
+
+perf_stat_t lcd_latency_stat[LCD_LATENCY_ELEMENTS][LCD_LATENCY_STAGES];
+
+/*
+ * emWin heap instrumentation, "lcd heap". The allocator has no hooks, so
+ * the lcd thread samples it where it peaks: after a memory device is
+ * created and after each drawn element. Sampling walks the block list of
+ * the allocator, it is off unless LCD_HEAP_TRACK, "lcd heap on" or a soak
+ * run turns it on. Startup is always sampled.
+ */
+#ifndef LCD_HEAP_TRACK
+#define LCD_HEAP_TRACK                          (0)
+#endif
+
+/* The recommended size is the peak plus 1 / LCD_HEAP_MARGIN_DIV, in KB */
+#define LCD_HEAP_MARGIN_DIV                     (4)
+
+#define LCD_HEAP_STARTUP                        (0)
+#define LCD_HEAP_BUTTON                         (1)
+#define LCD_HEAP_SLIDER                         (2)
+#define LCD_HEAP_TEXT                           (3)
+#define LCD_HEAP_OPS                            (4)
+
+typedef struct {
+	uint32_t samples;
+	uint32_t peak;
+	uint32_t op_peak[LCD_HEAP_OPS];
+	uint32_t min_free;
+	uint32_t min_largest;                   /* largest free block */
+	uint32_t max_frag;                      /* % of the free bytes outside the largest block */
+} lcd_heap_stat_t;
+
+const char *lcd_heap_op_names[] = { "startup", "button", "slider", "text" };
+
+bool lcd_heap_track = LCD_HEAP_TRACK;
+int lcd_heap_op = LCD_HEAP_STARTUP;
+lcd_heap_stat_t lcd_heap_stat = { 0, 0, {0}, UINT32_MAX, UINT32_MAX, 0 };
+
+/*
+ * Ways to draw buttons and slider, "lcd draw" switches at run time
+ *   LCD_DRAW_DIRECT: emWin primitives on the display
+ *   LCD_DRAW_MEMDEV: the primitives into a memory device over the static
+ *     background, copied with one window write. Devices are created per
+ *     update, the largest is the slider when the thumb jumps across the
+ *     track, 261 x 21 x 2 bytes, which leaves most of GUI_NUMBYTES to emWin.
+ *   LCD_DRAW_SPRITE: bitmaps rendered once at startup the memory device way,
+ *     one window write of the bitmap per element.
+ */
+#define LCD_DRAW_DIRECT                         (0)
+#define LCD_DRAW_MEMDEV                         (1)
+#define LCD_DRAW_SPRITE                         (2)
+
+#ifndef LCD_DRAW_MODE
+#define LCD_DRAW_MODE                           LCD_DRAW_SPRITE
+#endif
 
+int lcd_draw_mode = LCD_DRAW_MODE;
+const char *lcd_draw_mode_names[] = { "direct", "memdev", "sprite" };
+
+#define LCD_BUTTON_SIZE                         (2 * LCD_BUTTON_R + 1)
+#define LCD_THUMB_W                             (LCD_SLIDER_DX + 1)
+#define LCD_THUMB_H                             (LCD_SLIDER_DY + 1)
+
+/* RGB565 pixels of the sprites, in RAM as they are rendered by emWin at startup */
+U16 lcd_button_pixels[LCD_BUTTONS][2][LCD_BUTTON_SIZE * LCD_BUTTON_SIZE];
+U16 lcd_thumb_pixels[LCD_THUMB_W * LCD_THUMB_H];
+U16 lcd_track_pixels[LCD_THUMB_W * LCD_THUMB_H];
+
+GUI_BITMAP lcd_button_sprite[LCD_BUTTONS][2];
+GUI_BITMAP lcd_thumb_sprite;
+GUI_BITMAP lcd_track_sprite;
+bool lcd_sprites_ready = false;
+
+
+
+/*
+ * The previous per line text path: a wrapped line in a fixed slot, font
+ * and colors set on every call. Only "lcd textbench" uses it.
+ */
+void lcd_draw_text_wrap(const char *text,int line){
+	   GUI_SetFont(&GUI_Font24_1);
+
+	   GUI_RECT Rect = {20,50+line*30,300,50+(line+1)*30};
 
 	   GUI_SetClearTextRectMode(1u);
 	   GUI_SetBkColor(GUI_DARKGREEN);
 	   GUI_SetColor(GUI_LIGHTGRAY);
 
+		GUI_DispStringInRectWrap(text , &Rect, GUI_TA_CENTER, GUI_WRAPMODE_WORD );
+}
 
+/* Colors of the console rows, once per render. The font is set once at startup. */
+void lcd_console_begin(){
+	GUI_SetBkColor(GUI_DARKGREEN);
+	GUI_SetColor(GUI_LIGHTGRAY);
+}
 
+void lcd_console_draw_row(const char *text,int row){
+	GUI_RECT rect = { LCD_CONSOLE_X0, LCD_CONSOLE_Y0+row*LCD_CONSOLE_ROW_H,
+			LCD_CONSOLE_X1, LCD_CONSOLE_Y0+(row+1)*LCD_CONSOLE_ROW_H-1 };
 
-		GUI_DispStringInRectWrap(text , &Rect, GUI_TA_CENTER, GUI_WRAPMODE_WORD );
+	GUI_DispStringInRect(text,&rect,GUI_TA_LEFT|GUI_TA_VCENTER);
 }
 
-void lcd_draw_text(const char *text,int line){
-	 lcd_queue.call(lcd_draw_text_thread,text,line);
+void lcd_console_format(const lcd_console_line_t *line,char *row){
+	if (line->repeat>1)
+		snprintf(row,LCD_CONSOLE_ROW_MAX,"%s (x%lu)",line->text,line->repeat);
+	else
+		snprintf(row,LCD_CONSOLE_ROW_MAX,"%s",line->text);
 }
 
-void lcd_draw_text_delay(const char *text,int line,int delay_ms){
-	 lcd_queue.call_in(delay_ms,lcd_draw_text_thread,text,line);
+/*
+ * The lines of the rows top down, called with lcd_state_mutex held. Lines
+ * stay in the order written, a burst faster than the frames pushes the
+ * older ones out of the rows before any frame showed them.
+ */
+void lcd_console_snapshot(lcd_console_line_t *rows){
+	uint32_t count=lcd_state.console_count;
+
+	if (count-lcd_state.console_shown>LCD_CONSOLE_ROWS)
+		lcd_render_stat.console_unshown+=count-lcd_state.console_shown-LCD_CONSOLE_ROWS;
+	lcd_state.console_shown=count;
+
+	for (int row=0;row<LCD_CONSOLE_ROWS;row++){
+		uint32_t n=count-LCD_CONSOLE_ROWS+row;
+
+		if (count<(uint32_t)(LCD_CONSOLE_ROWS-row))
+			memset(&rows[row],0,sizeof(rows[row]));
+		else
+			rows[row]=lcd_state.console[n%LCD_CONSOLE_LINES];
+	}
 }
 
-void lcd_show_button_thread(int button_id,int onoff){
-	int x=50;
-	int y=200;
-	U32 color=0x00D3D300;
+/* The lcd thread sleeps while the DMA of cy_tft.c streams a fill */
+Semaphore lcd_dma_sem(0,1);
+
+extern "C" void cy_tft_dma_wait(void){
+	lcd_dma_sem.acquire();
+}
+
+extern "C" void cy_tft_dma_done(void){
+	lcd_dma_sem.release();
+}
+
+
+/*
+ * Display idle policy. Without activity the display is dimmed after
+ * lcd_dim_ms and put to sleep after lcd_sleep_ms, 0 disables a step.
+ * Sleep is display off and sleep in, the controller keeps its GRAM and
+ * still takes writes, so a wake is sleep out and display on, no redraw.
+ * The kit has no backlight switch, dim is the 8 color idle mode and the
+ * brightness register, which acts only on a backlight driven by LEDPWM.
+ * Any state change is activity, a touch or a new console line wakes.
+ */
+#define LCD_POWER_ON                            (0)
+#define LCD_POWER_DIM                           (1)
+#define LCD_POWER_SLEEP                         (2)
+#define LCD_POWER_STATES                        (3)
+
+#ifndef LCD_DIM_TIMEOUT_MS
+#define LCD_DIM_TIMEOUT_MS                      (15000u)
+#endif
+
+#ifndef LCD_SLEEP_TIMEOUT_MS
+#define LCD_SLEEP_TIMEOUT_MS                    (30000u)
+#endif
+
+#define LCD_POWER_CHECK_PERIOD_MS               (1000)
+
+#define LCD_BRIGHTNESS_ON                       (0xff)
+#define LCD_BRIGHTNESS_DIM                      (0x20)
+
+/* Brightness control, display dimming and backlight on */
+#define LCD_CTRLD_ON                            (0x2c)
+
+/* Typical controller and panel supply current from the datasheet, without backlight */
+#ifndef LCD_CURRENT_ON_UA
+#define LCD_CURRENT_ON_UA                       (6000u)
+#endif
+
+#ifndef LCD_CURRENT_DIM_UA
+#define LCD_CURRENT_DIM_UA                      (3000u)
+#endif
+
+#ifndef LCD_CURRENT_SLEEP_UA
+#define LCD_CURRENT_SLEEP_UA                    (15u)
+#endif
+
+const char *lcd_power_names[]={ "on", "dim", "sleep" };
+const uint32_t lcd_power_current_ua[]={ LCD_CURRENT_ON_UA, LCD_CURRENT_DIM_UA, LCD_CURRENT_SLEEP_UA };
+
+/* written by the lcd thread only */
+volatile int lcd_power_state=LCD_POWER_ON;
+uint64_t lcd_power_since_ms=0;
+uint64_t lcd_power_time_ms[LCD_POWER_STATES];
+uint64_t lcd_sleep_change_ms=0;
+
+/* lcd_sleep() holds the display off until lcd_wake() */
+volatile bool lcd_power_hold=false;
+
+uint32_t lcd_dim_ms=LCD_DIM_TIMEOUT_MS;
+uint32_t lcd_sleep_ms=LCD_SLEEP_TIMEOUT_MS;
+
+/* 32 bit so it is written and read in one access, compared wrap safe */
+volatile uint32_t lcd_activity_ms=0;
+volatile bool lcd_wake_posted=false;
+
+/* activity to display on after sleep, perf_cycles() */
+volatile uint32_t lcd_wake_start=0;
+perf_stat_t lcd_wake_stat;
+
+void lcd_power_set(int state);
+void lcd_power_check();
+void lcd_power_wake_thread();
+
+void lcd_activity(){
+	lcd_activity_ms=(uint32_t)Kernel::get_ms_count();
+
+	/* at most one wake call queued */
+	if (lcd_power_state==LCD_POWER_ON || lcd_power_hold || core_util_atomic_exchange_bool(&lcd_wake_posted,true))
+		return;
+
+	lcd_wake_start=perf_cycles();
+	if (!lcd_queue.call(lcd_power_wake_thread))
+		core_util_atomic_store_bool(&lcd_wake_posted,false);
+}
+
+void lcd_mark_dirty(uint32_t bits){
+	/* called with lcd_state_mutex held */
+	lcd_dirty|=bits;
+
+	/* the wake goes first, the render lands on a visible display */
+	lcd_activity();
+
+	if (!lcd_render_posted){
+		uint64_t now=Kernel::get_ms_count();
+		int delay=lcd_frame_next_ms>now ? (int)(lcd_frame_next_ms-now) : 0;
+
+		lcd_render_posted=true;
+		if (!lcd_queue.call_in(delay,lcd_render))
+			lcd_render_posted=false;
+	}
+}
+
+void lcd_console_write(const char *text){
+	lcd_state_mutex.lock();
+	lcd_console_line_t *last=lcd_state.console_count ?
+			&lcd_state.console[(lcd_state.console_count-1)%LCD_CONSOLE_LINES] : NULL;
+
+	if (last && !strncmp(last->text,text,LCD_CONSOLE_COLS-1)){
+		last->repeat++;
+	} else {
+		lcd_console_line_t *line=&lcd_state.console[lcd_state.console_count%LCD_CONSOLE_LINES];
+
+		strncpy(line->text,text,LCD_CONSOLE_COLS-1);
+		line->text[LCD_CONSOLE_COLS-1]='\0';
+		line->repeat=1;
+		lcd_state.console_count++;
+	}
+	lcd_mark_dirty(LCD_DIRTY_CONSOLE);
+	lcd_state_mutex.unlock();
+}
+
+void lcd_heap_reset(){
+	memset(&lcd_heap_stat,0,sizeof(lcd_heap_stat));
+	lcd_heap_stat.min_free=UINT32_MAX;
+	lcd_heap_stat.min_largest=UINT32_MAX;
+}
+
+void lcd_heap_sample(){
+	if (!lcd_heap_track)
+		return;
+
+	lcd_heap_stat_t *stat=&lcd_heap_stat;
+	uint32_t used=GUI_ALLOC_GetNumUsedBytes();
+	uint32_t free_bytes=GUI_ALLOC_GetNumFreeBytes();
+	uint32_t largest=GUI_ALLOC_GetMaxSize();
+
+	stat->samples++;
+	stat->peak=std::max(stat->peak,used);
+	stat->op_peak[lcd_heap_op]=std::max(stat->op_peak[lcd_heap_op],used);
+	stat->min_free=std::min(stat->min_free,free_bytes);
+	stat->min_largest=std::min(stat->min_largest,largest);
+	if (free_bytes)
+		stat->max_frag=std::max(stat->max_frag,(uint32_t)(100-largest*100ull/free_bytes));
+}
+
+void lcd_heap_print(){
+	lcd_heap_stat_t *stat=&lcd_heap_stat;
+	uint32_t size=GUI_X_GetNumBytes();
+	uint32_t recommended=(stat->peak+stat->peak/LCD_HEAP_MARGIN_DIV+1023)/1024*1024;
+
+	printf("emWin heap: %lu bytes, tracking %s, samples: %lu\n",size,lcd_heap_track?"on":"off",stat->samples);
+	if (!stat->samples)
+		return;
+
+	printf("peak used: %lu min free: %lu min largest free block: %lu max fragmentation: %lu %%\n",
+			stat->peak,stat->min_free,stat->min_largest,stat->max_frag);
+	for (int op=0;op<LCD_HEAP_OPS;op++)
+		printf("  %-8s peak used: %lu\n",lcd_heap_op_names[op],stat->op_peak[op]);
+	printf("recommended emwin-numbytes: %lu, %ld bytes %s\n",recommended,
+			(long)size-(long)recommended,size>=recommended?"spare":"short");
+}
+
+/* Background without buttons and slider, the bk color is left as the panel color */
+void lcd_draw_static(){
+	   // GUI_SetFont(&GUI_Font32B_1);
+	    GUI_SetBkColor(GUI_DARKRED);
+	    GUI_SetColor(GUI_LIGHTGRAY);
+	  //  GUI_SetPenSize(20);
+
+	    GUI_Clear();
+	    GUI_SetColor(GUI_DARKGREEN);
+	    GUI_FillRoundedRect(20,20,300,220,5);
+
+	    GUI_SetColor(GUI_LIGHTGRAY);
+
+	    GUI_FillRoundedRect(30,152,285,158,2);
+
+	    GUI_SetBkColor(GUI_DARKGREEN);
+}
+
+/* Select a memory device of the rectangle with the static background */
+GUI_MEMDEV_Handle lcd_memdev_create(int x0,int y0,int x1,int y1){
+	if (x1<x0 || y1<y0)
+		return 0;
+
+	GUI_MEMDEV_Handle mem=GUI_MEMDEV_Create(x0,y0,x1-x0+1,y1-y0+1);
+	if (!mem){
+		lcd_render_stat.memdev_failed++;
+		return 0;
+	}
+
+	GUI_MEMDEV_Select(mem);
+	lcd_heap_sample();
+	lcd_draw_static();
+	return mem;
+}
+
+/* As lcd_memdev_create in LCD_DRAW_MEMDEV mode, 0 to draw directly */
+GUI_MEMDEV_Handle lcd_memdev_begin(int x0,int y0,int x1,int y1){
+	if (lcd_draw_mode!=LCD_DRAW_MEMDEV)
+		return 0;
+
+	return lcd_memdev_create(x0,y0,x1,y1);
+}
+
+void lcd_memdev_end(GUI_MEMDEV_Handle mem){
+	if (!mem)
+		return;
+
+	GUI_MEMDEV_Select(0);
+	GUI_MEMDEV_CopyToLCD(mem);
+	GUI_MEMDEV_Delete(mem);
+}
+
+/* Keep the pixels of a memory device as a bitmap and delete the device */
+bool lcd_sprite_capture(GUI_MEMDEV_Handle mem,GUI_BITMAP *sprite,U16 *pixels,int w,int h){
+	GUI_MEMDEV_Select(0);
+
+	if (!mem)
+		return false;
+
+	if (GUI_MEMDEV_GetBitsPerPixel(mem)!=16){
+		GUI_MEMDEV_Delete(mem);
+		return false;
+	}
+
+	memcpy(pixels,GUI_MEMDEV_GetDataPtr(mem),w*h*sizeof(U16));
+	GUI_MEMDEV_Delete(mem);
+
+	sprite->XSize=w;
+	sprite->YSize=h;
+	sprite->BytesPerLine=w*sizeof(U16);
+	sprite->BitsPerPixel=16;
+	sprite->pData=(const U8 *)pixels;
+	sprite->pPal=NULL;
+	sprite->pMethods=GUI_DRAW_BMPM565;
+	return true;
+}
+
+
+void lcd_button_geometry(int button_id,int onoff,int *x,U32 *color){
+	*x=50;
+	*color=0x00D3D300;
 
 
 
@@ -58,16 +593,18 @@ void lcd_show_button_thread(int button_id,int onoff){
 	case 0:
 		break;
 	case 1:
-		color=0x00FF0000;
-		x=320-50;
+		*color=0x00FF0000;
+		*x=320-50;
 		break;
 
 	}
 
 	if (!onoff){
-		color=GUI_DARKGRAY;
+		*color=GUI_DARKGRAY;
 	}
+}
 
+void lcd_button_art(int x,int y,U32 color,int onoff){
 	GUI_SetColor(GUI_MAKE_COLOR(color));
 
 	int inc = onoff?1:-1;
@@ -78,6 +615,31 @@ void lcd_show_button_thread(int button_id,int onoff){
 	}
 
 	//GUI_FillCircle(x,y,25);
+}
+
+void lcd_thumb_art(int x,int y){
+	GUI_SetColor(GUI_BLACK);
+	GUI_FillRoundedRect(x,y,x+LCD_SLIDER_DX,y+LCD_SLIDER_DY,2);
+}
+
+void lcd_show_button_thread(int button_id,int onoff){
+	int x;
+	int y=LCD_BUTTON_Y;
+	U32 color;
+
+	if (lcd_draw_mode==LCD_DRAW_SPRITE && lcd_sprites_ready && button_id>=0 && button_id<LCD_BUTTONS){
+		lcd_button_geometry(button_id,onoff,&x,&color);
+		GUI_DrawBitmap(&lcd_button_sprite[button_id][onoff?1:0],x-LCD_BUTTON_R,y-LCD_BUTTON_R);
+		return;
+	}
+
+	lcd_button_geometry(button_id,onoff,&x,&color);
+
+	GUI_MEMDEV_Handle mem=lcd_memdev_begin(x-LCD_BUTTON_R,y-LCD_BUTTON_R,x+LCD_BUTTON_R,y+LCD_BUTTON_R);
+
+	lcd_button_art(x,y,color,onoff);
+
+	lcd_memdev_end(mem);
 
 
 }
@@ -99,83 +661,896 @@ void lcd_show_slice_thread(int pos){
 
 
 
-	int dx = 5;
-	int dy = 20;
+	int dx = LCD_SLIDER_DX;
+	int dy = LCD_SLIDER_DY;
 	int x = 35+pos*0.8;
 	int lastx=35+lcd_slice_pos*0.8;
-	int y = 145;
-
+	int y = LCD_SLIDER_Y;
 
+	if (lcd_draw_mode==LCD_DRAW_SPRITE && lcd_sprites_ready){
+		GUI_DrawBitmap(&lcd_track_sprite,lastx,y);
+		GUI_DrawBitmap(&lcd_thumb_sprite,x,y);
+		lcd_slice_pos=pos;
+		return;
+	}
 
+	/* old and new thumb, the background comes with the memory device */
+	GUI_MEMDEV_Handle mem=lcd_memdev_begin(std::max(std::min(x,lastx),LCD_SLIDER_X0),y,
+			std::min(std::max(x,lastx)+dx,LCD_SLIDER_X1),y+dy);
 
+	if (!mem){
+		GUI_SetColor(GUI_GetBkColor());
+		GUI_FillRoundedRect(lastx,y,lastx+dx,y+dy,2);
 
-	GUI_SetColor(GUI_GetBkColor());
-	GUI_FillRoundedRect(lastx,y,lastx+dx,y+dy,2);
 
+		GUI_SetColor(GUI_LIGHTGRAY);
+			GUI_FillRect(lastx,152,lastx+dx,158);
+	}
 
-	GUI_SetColor(GUI_LIGHTGRAY);
-		GUI_FillRect(lastx,152,lastx+dx,158);
 
+	lcd_thumb_art(x,y);
 
-	GUI_SetColor(GUI_BLACK);
-	GUI_FillRoundedRect(x,y,x+dx,y+dy,2);
+	lcd_memdev_end(mem);
 
 	lcd_slice_pos=pos;
 
 }
 
+/*
+ * Render the sprites over the static background. The track and thumb are
+ * taken in the middle of the track, the background is the same all along.
+ */
+void lcd_sprites_init(){
+	const int tx=150;
+	bool ready=true;
+
+	for (int id=0;id<LCD_BUTTONS;id++){
+		for (int onoff=0;onoff<2;onoff++){
+			int x;
+			U32 color;
+
+			lcd_button_geometry(id,onoff,&x,&color);
+			GUI_MEMDEV_Handle mem=lcd_memdev_create(x-LCD_BUTTON_R,LCD_BUTTON_Y-LCD_BUTTON_R,
+					x+LCD_BUTTON_R,LCD_BUTTON_Y+LCD_BUTTON_R);
+			if (mem)
+				lcd_button_art(x,LCD_BUTTON_Y,color,onoff);
+			ready&=lcd_sprite_capture(mem,&lcd_button_sprite[id][onoff],lcd_button_pixels[id][onoff],
+					LCD_BUTTON_SIZE,LCD_BUTTON_SIZE);
+		}
+	}
+
+	GUI_MEMDEV_Handle mem=lcd_memdev_create(tx,LCD_SLIDER_Y,tx+LCD_SLIDER_DX,LCD_SLIDER_Y+LCD_SLIDER_DY);
+	ready&=lcd_sprite_capture(mem,&lcd_track_sprite,lcd_track_pixels,LCD_THUMB_W,LCD_THUMB_H);
+
+	mem=lcd_memdev_create(tx,LCD_SLIDER_Y,tx+LCD_SLIDER_DX,LCD_SLIDER_Y+LCD_SLIDER_DY);
+	if (mem)
+		lcd_thumb_art(tx,LCD_SLIDER_Y);
+	ready&=lcd_sprite_capture(mem,&lcd_thumb_sprite,lcd_thumb_pixels,LCD_THUMB_W,LCD_THUMB_H);
+
+	lcd_sprites_ready=ready;
+}
+
+/* A change of an element caused by an event, called with lcd_state_mutex held */
+void lcd_latency_begin(int element,const app_event_t *event){
+	lcd_latency_mark_t *mark=&lcd_latency_mark[element];
+
+	if (!event || mark->valid)
+		return;
+
+	mark->valid=true;
+	mark->origin=event->origin;
+	mark->published=event->timestamp;
+	mark->handled=perf_cycles();
+}
+
+/* The element is on the display, start is when its draw began */
+void lcd_latency_end(const lcd_latency_mark_t *mark,int element,uint32_t start){
+	perf_stat_t *stat=lcd_latency_stat[element];
+	uint32_t end=perf_cycles();
+
+	if (!mark->valid)
+		return;
+
+	perf_stat_add(&stat[LCD_LATENCY_SCAN],mark->published-mark->origin);
+	perf_stat_add(&stat[LCD_LATENCY_DISPATCH],mark->handled-mark->published);
+	perf_stat_add(&stat[LCD_LATENCY_QUEUED],start-mark->handled);
+	perf_stat_add(&stat[LCD_LATENCY_RENDER],end-start);
+	perf_stat_add(&stat[LCD_LATENCY_TOTAL],end-mark->origin);
+}
+
+void lcd_set_button_event(int button_id,int onoff,const app_event_t *event){
+	if (button_id<0 || button_id>=LCD_BUTTONS)
+		return;
+
+	lcd_state_mutex.lock();
+	if (lcd_state.button[button_id]!=onoff){
+		lcd_state.button[button_id]=onoff;
+		lcd_latency_begin(button_id,event);
+		lcd_mark_dirty(LCD_DIRTY_BUTTON(button_id));
+	}
+	lcd_state_mutex.unlock();
+}
+
+void lcd_set_button(int button_id,int onoff){
+	lcd_set_button_event(button_id,onoff,NULL);
+}
+
 void lcd_show_button(int button_id){
-	lcd_queue.call(lcd_show_button_thread,button_id,1u);
-	 //lcd_queue.call(lcd_draw_text_thread,text,line);
+	lcd_set_button(button_id,1);
 }
 
 void lcd_close_button(int button_id){
-	lcd_queue.call(lcd_show_button_thread,button_id,0u);
-	 //lcd_queue.call(lcd_draw_text_thread,text,line);
+	lcd_set_button(button_id,0);
 }
 
-void lcd_show_slice(int pos){
-	 lcd_queue.call(lcd_show_slice_thread,pos);
+void lcd_show_slice_event(int pos,const app_event_t *event){
+	lcd_state_mutex.lock();
+	if (lcd_state.slider_pos!=pos){
+		lcd_state.slider_pos=pos;
+		lcd_latency_begin(LCD_LATENCY_SLIDER,event);
+		lcd_mark_dirty(LCD_DIRTY_SLIDER);
+	}
+	lcd_state_mutex.unlock();
 }
 
+void lcd_show_slice(int pos){
+	lcd_show_slice_event(pos,NULL);
+}
 
 
+void lcd_render(){
+	lcd_state_t *state=&lcd_state;
+	int button[LCD_BUTTONS];
+	int slider_pos;
+	lcd_console_line_t rows[LCD_CONSOLE_ROWS];
+	lcd_latency_mark_t marks[LCD_LATENCY_ELEMENTS];
+	char text[LCD_CONSOLE_ROW_MAX];
+	uint32_t dirty;
+	uint32_t start=perf_cycles();
+
+	lcd_state_mutex.lock();
+	lcd_render_posted=false;
+	if (!lcd_ready){
+		lcd_state_mutex.unlock();
+		return;
+	}
+	lcd_frame_next_ms=Kernel::get_ms_count()+lcd_frame_ms;
+	dirty=lcd_dirty;
+	lcd_dirty=0;
+	memcpy(button,state->button,sizeof(button));
+	slider_pos=state->slider_pos;
+	if (dirty & LCD_DIRTY_CONSOLE)
+		lcd_console_snapshot(rows);
+	memcpy(marks,lcd_latency_mark,sizeof(marks));
+	memset(lcd_latency_mark,0,sizeof(lcd_latency_mark));
+	lcd_state_mutex.unlock();
+
+	lcd_render_stat.renders++;
+
+	for (int i=0;i<LCD_BUTTONS;i++){
+		if (dirty & LCD_DIRTY_BUTTON(i)){
+			uint32_t bytes=LCD_X_GetBusBytes();
+			uint32_t reads=lcd_read_count();
+			uint32_t drawn=perf_cycles();
+			lcd_heap_op=LCD_HEAP_BUTTON;
+			lcd_show_button_thread(i,button[i]);
+			lcd_latency_end(&marks[i],i,drawn);
+			lcd_heap_sample();
+			lcd_render_stat.buttons++;
+			lcd_render_stat.button_bytes+=LCD_X_GetBusBytes()-bytes;
+			lcd_render_stat.button_reads+=lcd_read_count()-reads;
+		}
+	}
 
-void lcd_startup_thread(){
-	  GUI_Init();
+	if (dirty & LCD_DIRTY_SLIDER){
+		uint32_t bytes=LCD_X_GetBusBytes();
+		uint32_t reads=lcd_read_count();
+		uint32_t drawn=perf_cycles();
+		lcd_heap_op=LCD_HEAP_SLIDER;
+		lcd_show_slice_thread(slider_pos);
+		lcd_latency_end(&marks[LCD_LATENCY_SLIDER],LCD_LATENCY_SLIDER,drawn);
+		lcd_heap_sample();
+		lcd_render_stat.sliders++;
+		lcd_render_stat.slider_bytes+=LCD_X_GetBusBytes()-bytes;
+		lcd_render_stat.slider_reads+=lcd_read_count()-reads;
+	}
 
-	   // GUI_SetFont(&GUI_Font32B_1);
-	    GUI_SetBkColor(GUI_DARKRED);
-	    GUI_SetColor(GUI_LIGHTGRAY);
-	  //  GUI_SetPenSize(20);
+	if (dirty & LCD_DIRTY_CONSOLE){
+		uint32_t reads=lcd_read_count();
+		lcd_heap_op=LCD_HEAP_TEXT;
+		lcd_console_begin();
+
+		for (int row=0;row<LCD_CONSOLE_ROWS;row++){
+			lcd_console_format(&rows[row],text);
+			if (lcd_console_valid && !strcmp(text,lcd_console_drawn[row])){
+				lcd_render_stat.rows_unchanged++;
+				continue;
+			}
+
+			lcd_console_draw_row(text,row);
+			strcpy(lcd_console_drawn[row],text);
+			lcd_render_stat.rows++;
+		}
+
+		lcd_console_valid=true;
+		lcd_heap_sample();
+		lcd_render_stat.row_reads+=lcd_read_count()-reads;
+	}
 
-	    GUI_Clear();
-	    GUI_SetColor(GUI_DARKGREEN);
-	    GUI_FillRoundedRect(20,20,300,220,5);
+	uint32_t cycles=perf_cycles()-start;
+	uint32_t us=perf_cycles_to_us(cycles);
 
-	    GUI_SetColor(GUI_LIGHTGRAY);
+	perf_stat_add(&lcd_frame_stat,cycles);
+	lcd_frame_busy_us+=us;
+	lcd_frame_missed+=us/(lcd_frame_ms*1000);
+}
 
-	    GUI_FillRoundedRect(30,152,285,158,2);
 
 
 
+void lcd_draw_background(){
+	    lcd_draw_static();
+	    lcd_console_valid=false;
 
 	    lcd_show_button_thread(0,0);
 	    lcd_show_button_thread(1,0);
 
 
-	    lcd_show_slice_thread(180);
+	    lcd_slice_pos=-250;
+	    lcd_show_slice_thread(LCD_SLIDER_START_POS);
 
 	    GUI_SetColor(GUI_DARKGREEN);
+}
+
+void lcd_startup_thread(){
+	    bool track=lcd_heap_track;
+
+	    GUI_Init();
+	    boot_mark("gui init");
+	    GUI_SetFont(&LCD_CONSOLE_FONT);
+	    GUI_SetClearTextRectMode(1u);
+
+	    lcd_heap_track=true;
+	    lcd_heap_op=LCD_HEAP_STARTUP;
+	    lcd_heap_sample();
+	    lcd_sprites_init();
+	    lcd_draw_background();
+	    lcd_heap_track=track;
+
+	    /* draw what was set before the display was up */
+	    lcd_state_mutex.lock();
+	    lcd_ready=true;
+	    lcd_dirty|=LCD_DIRTY_BUTTON(0)|LCD_DIRTY_BUTTON(1)|LCD_DIRTY_SLIDER|LCD_DIRTY_CONSOLE;
+	    lcd_state_mutex.unlock();
+	    lcd_render();
+
+	    lcd_power_since_ms=Kernel::get_ms_count();
+	    lcd_activity_ms=(uint32_t)lcd_power_since_ms;
+	    lcd_queue.call_every(LCD_POWER_CHECK_PERIOD_MS,lcd_power_check);
+
+	    lcd_ready_flags.set(LCD_READY_FLAG);
+}
+
+void lcd_wait_ready(){
+	lcd_ready_flags.wait_all(LCD_READY_FLAG,osWaitForever,false);
+}
+
+
+/* Redraw everything from the retained state, after the GRAM was overwritten */
+void lcd_redraw_thread(){
+	    lcd_draw_background();
+
+	    lcd_state_mutex.lock();
+	    lcd_dirty|=LCD_DIRTY_BUTTON(0)|LCD_DIRTY_BUTTON(1)|LCD_DIRTY_SLIDER|LCD_DIRTY_CONSOLE;
+	    lcd_state_mutex.unlock();
+	    lcd_render();
+}
+
+
+/*
+ * "lcd bench": full screen of pixel data through the HAL per pin path, the
+ * port-wide fast path and the DMA transport of cy_tft.c, with changing
+ * pixels and with a fill color, then the screen is redrawn. The DMA only
+ * takes fills, the lcd thread sleeps meanwhile.
+ */
+#define LCD_BENCH_BYTES                         (320 * 240 * 2)
+
+typedef struct {
+	const char *name;
+	bool fast;
+	bool dma;
+} lcd_bench_mode_t;
+
+void lcd_bench_window(){
+	/* CASET, RASET of the whole screen in the rotation in use, RAMWR */
+	int x1=LCD_GetXSize()-1;
+	int y1=LCD_GetYSize()-1;
+
+	cy_tft_write_command(0x2A);
+	cy_tft_write_data(0x00);
+	cy_tft_write_data(0x00);
+	cy_tft_write_data(x1>>8);
+	cy_tft_write_data(x1&0xFF);
+	cy_tft_write_command(0x2B);
+	cy_tft_write_data(0x00);
+	cy_tft_write_data(0x00);
+	cy_tft_write_data(y1>>8);
+	cy_tft_write_data(y1&0xFF);
+	cy_tft_write_command(0x2C);
+}
+
+void lcd_bench_run(const char *name,const char *kind,uint8_t *pattern,int size){
+	lcd_bench_window();
+
+	uint32_t start=us_ticker_read();
+	for (int n=0;n<LCD_BENCH_BYTES;n+=size)
+		cy_tft_write_data_stream(pattern,size);
+	uint32_t us=us_ticker_read()-start;
+
+	printf("%-4s %-6s: %d bytes in %lu us, %lu bytes/s, %lu pixels/s\n",name,kind,
+			LCD_BENCH_BYTES,us,(uint32_t)(LCD_BENCH_BYTES*1000000ull/us),
+			(uint32_t)(LCD_BENCH_BYTES/2*1000000ull/us));
+}
+
+void lcd_bench_thread(){
+	static const lcd_bench_mode_t modes[]={
+		{ "hal", false, false },
+		{ "port", true, false },
+		{ "dma", true, true },
+	};
+	static uint8_t pixels[256];
+	static uint8_t fill[256];
+
+	for (int i=0;i<(int)sizeof(pixels);i++){
+		pixels[i]=i*37;
+		fill[i]=(i&1)?0x5A:0xA5;
+	}
+
+	for (unsigned m=0;m<sizeof(modes)/sizeof(modes[0]);m++){
+		if (cy_tft_set_fast_io(modes[m].fast)!=modes[m].fast || cy_tft_set_dma(modes[m].dma)!=modes[m].dma){
+			printf("%s: not available\n",modes[m].name);
+			continue;
+		}
+
+		if (!modes[m].dma)
+			lcd_bench_run(modes[m].name,"pixels",pixels,sizeof(pixels));
+		lcd_bench_run(modes[m].name,"fill",fill,sizeof(fill));
+	}
+
+	cy_tft_set_fast_io(true);
+	cy_tft_set_dma(true);
+	LCD_X_InvalidateShadow();
+	lcd_redraw_thread();
+}
+
+
+/*
+ * "lcd drawbench": time and bus bytes of button and slider updates in each
+ * draw mode, then the screen is redrawn.
+ */
+#define LCD_DRAW_BENCH_COUNT                    (16)
+
+void lcd_draw_bench_thread(){
+	int mode=lcd_draw_mode;
+
+	for (int m=LCD_DRAW_DIRECT;m<=LCD_DRAW_SPRITE;m++){
+		perf_stat_t button_stat;
+		perf_stat_t slider_stat;
+		uint32_t button_bytes=0;
+		uint32_t slider_bytes=0;
+
+		perf_stat_reset(&button_stat);
+		perf_stat_reset(&slider_stat);
+		lcd_draw_mode=m;
+
+		for (int n=0;n<LCD_DRAW_BENCH_COUNT;n++){
+			uint32_t bytes=LCD_X_GetBusBytes();
+			uint32_t start=perf_cycles();
+			lcd_show_button_thread(0,n&1);
+			perf_stat_add(&button_stat,perf_cycles()-start);
+			button_bytes+=LCD_X_GetBusBytes()-bytes;
+
+			bytes=LCD_X_GetBusBytes();
+			start=perf_cycles();
+			lcd_show_slice_thread((n&1)?100:200);
+			perf_stat_add(&slider_stat,perf_cycles()-start);
+			slider_bytes+=LCD_X_GetBusBytes()-bytes;
+		}
+
+		printf("%-6s button avg: %lu max: %lu us %lu bytes, slider avg: %lu max: %lu us %lu bytes\n",
+				lcd_draw_mode_names[m],
+				perf_stat_avg_us(&button_stat),perf_cycles_to_us(button_stat.max),button_bytes/LCD_DRAW_BENCH_COUNT,
+				perf_stat_avg_us(&slider_stat),perf_cycles_to_us(slider_stat.max),slider_bytes/LCD_DRAW_BENCH_COUNT);
+	}
+
+	lcd_draw_mode=mode;
+	lcd_redraw_thread();
+}
+
+
+/*
+ * "lcd textbench": time and bus bytes per line of the previous wrapped
+ * slot path and of a console row, then the screen is redrawn.
+ */
+void lcd_text_bench_thread(){
+	perf_stat_t wrap_stat;
+	perf_stat_t row_stat;
+	uint32_t wrap_bytes=0;
+	uint32_t row_bytes=0;
+	char text[LCD_CONSOLE_ROW_MAX];
+
+	perf_stat_reset(&wrap_stat);
+	perf_stat_reset(&row_stat);
+
+	for (int n=0;n<LCD_DRAW_BENCH_COUNT;n++){
+		snprintf(text,sizeof(text),"text bench line %d",n);
+
+		uint32_t bytes=LCD_X_GetBusBytes();
+		uint32_t start=perf_cycles();
+		lcd_draw_text_wrap(text,n%3);
+		perf_stat_add(&wrap_stat,perf_cycles()-start);
+		wrap_bytes+=LCD_X_GetBusBytes()-bytes;
+	}
+
+	GUI_SetFont(&LCD_CONSOLE_FONT);
+
+	for (int n=0;n<LCD_DRAW_BENCH_COUNT;n++){
+		snprintf(text,sizeof(text),"text bench line %d",n);
+
+		uint32_t bytes=LCD_X_GetBusBytes();
+		uint32_t start=perf_cycles();
+		lcd_console_begin();
+		lcd_console_draw_row(text,n%LCD_CONSOLE_ROWS);
+		perf_stat_add(&row_stat,perf_cycles()-start);
+		row_bytes+=LCD_X_GetBusBytes()-bytes;
+	}
+
+	printf("wrapped line avg: %lu max: %lu us %lu bytes, console row avg: %lu max: %lu us %lu bytes\n",
+			perf_stat_avg_us(&wrap_stat),perf_cycles_to_us(wrap_stat.max),wrap_bytes/LCD_DRAW_BENCH_COUNT,
+			perf_stat_avg_us(&row_stat),perf_cycles_to_us(row_stat.max),row_bytes/LCD_DRAW_BENCH_COUNT);
+
+	lcd_redraw_thread();
+}
+
+
+/*
+ * "lcd orientbench": pixels/s of a full screen clear and of a block of
+ * text with the orientation in use, LCD_HW_ORIENTATION of LCDConf.cpp
+ * selects the controller or emWin, then the screen is redrawn.
+ */
+void lcd_orient_bench_thread(){
+	static const char text[]="The quick brown fox jumps over the lazy dog. "
+			"The quick brown fox jumps over the lazy dog.";
+	GUI_RECT rect={20,50,300,140};
+	uint32_t pixels=(rect.x1-rect.x0+1)*(rect.y1-rect.y0+1);
+	uint32_t bytes=LCD_X_GetBusBytes();
+	uint32_t start=us_ticker_read();
+
+	GUI_SetBkColor(GUI_DARKGREEN);
+	for (int n=0;n<LCD_DRAW_BENCH_COUNT;n++)
+		GUI_Clear();
+	uint32_t us=us_ticker_read()-start;
+
+	printf("rotation %d clear: %lu us, %lu pixels/s, %lu bus bytes\n",LCD_X_GetRotation()*90,
+			us/LCD_DRAW_BENCH_COUNT,(uint32_t)((uint64_t)LCD_GetXSize()*LCD_GetYSize()*LCD_DRAW_BENCH_COUNT*1000000ull/us),
+			(LCD_X_GetBusBytes()-bytes)/LCD_DRAW_BENCH_COUNT);
+
+	GUI_SetColor(GUI_LIGHTGRAY);
+	GUI_SetFont(&GUI_Font24_1);
+	bytes=LCD_X_GetBusBytes();
+	start=us_ticker_read();
+	for (int n=0;n<LCD_DRAW_BENCH_COUNT;n++)
+		GUI_DispStringInRectWrap(text,&rect,GUI_TA_LEFT,GUI_WRAPMODE_WORD);
+	us=us_ticker_read()-start;
+	GUI_SetFont(&LCD_CONSOLE_FONT);
+
+	printf("rotation %d text block: %lu us, %lu pixels/s, %lu bus bytes\n",LCD_X_GetRotation()*90,
+			us/LCD_DRAW_BENCH_COUNT,(uint32_t)((uint64_t)pixels*LCD_DRAW_BENCH_COUNT*1000000ull/us),
+			(LCD_X_GetBusBytes()-bytes)/LCD_DRAW_BENCH_COUNT);
+
+	lcd_redraw_thread();
+}
+
+/*
+ * "lcd fillbench": full screen clear with the pixel buffers FlexColor
+ * streams and with the repeated pixel fill, then the screen is redrawn.
+ */
+void lcd_fill_bench_thread(){
+	int repeat=LCD_X_SetFillRepeat(0);
+	uint32_t pixels=LCD_GetXSize()*LCD_GetYSize();
+
+	GUI_SetBkColor(GUI_DARKGREEN);
+	for (int mode=0;mode<2;mode++){
+		LCD_X_SetFillRepeat(mode);
+
+		uint32_t start=us_ticker_read();
+		for (int n=0;n<LCD_DRAW_BENCH_COUNT;n++)
+			GUI_Clear();
+		uint32_t us=(us_ticker_read()-start)/LCD_DRAW_BENCH_COUNT;
+
+		printf("%-8s clear: %lu us, %lu pixels/s\n",mode?"repeat":"buffered",us,
+				(uint32_t)(pixels*1000000ull/us));
+	}
+
+	LCD_X_SetFillRepeat(repeat);
+	lcd_redraw_thread();
+}
+
+/* Init the controller with another variant, name is a console argument */
+void lcd_init_thread(const char *name){
+	int ok=!LCD_X_SetInitVariant(name);
+
+	free((void *)name);
+	if (!ok){
+		printf("variants:");
+		for (int i=0;LCD_X_GetInitVariant(i);i++)
+			printf(" %s",LCD_X_GetInitVariant(i));
+		printf("\n");
+		return;
+	}
+
+	/* the init sequence ended with sleep out, bring the policy state along */
+	lcd_sleep_change_ms=Kernel::get_ms_count();
+	lcd_power_set(LCD_POWER_ON);
+	lcd_redraw_thread();
+}
+
+/*
+ * The layout is made for the landscape rotations 0 and 180, with 90 and
+ * 270 it is cut at the bottom of the 240 pixel wide screen.
+ */
+void lcd_rotate_thread(int rotation){
+	if (LCD_X_SetRotation(rotation)){
+		printf("rotation not supported\n");
+		return;
+	}
+
+	lcd_redraw_thread();
+}
+
+
+/*
+ * "lcd heap soak <n>": n updates of each kind in each draw mode with the
+ * heap tracked, slider jumps across the whole track in between small
+ * steps, then the screen is redrawn and the heap statistics printed.
+ */
+void lcd_heap_soak_thread(int count){
+	bool track=lcd_heap_track;
+	int mode=lcd_draw_mode;
+	char text[LCD_CONSOLE_ROW_MAX];
+
+	lcd_heap_track=true;
+
+	for (int m=LCD_DRAW_DIRECT;m<=LCD_DRAW_SPRITE;m++){
+		lcd_draw_mode=m;
+
+		for (int n=0;n<count;n++){
+			lcd_heap_op=LCD_HEAP_BUTTON;
+			lcd_show_button_thread(n%LCD_BUTTONS,(n/LCD_BUTTONS)&1);
+			lcd_heap_sample();
+
+			lcd_heap_op=LCD_HEAP_SLIDER;
+			lcd_show_slice_thread((n&2) ? (n*7)%300 : ((n&1)?0:300));
+			lcd_heap_sample();
+
+			lcd_heap_op=LCD_HEAP_TEXT;
+			snprintf(text,sizeof(text),"heap soak %s %d",lcd_draw_mode_names[m],n);
+			lcd_console_begin();
+			lcd_console_draw_row(text,n%LCD_CONSOLE_ROWS);
+			lcd_heap_sample();
+		}
+	}
+
+	lcd_draw_mode=mode;
+	lcd_redraw_thread();
+	lcd_heap_track=track;
+	lcd_heap_print();
+}
+
+
+void lcd_write_brightness(uint8_t value){
+	cy_tft_write_command(LCD_CMD_WRCTRLD);
+	cy_tft_write_data(LCD_CTRLD_ON);
+	cy_tft_write_command(LCD_CMD_WRDISBV);
+	cy_tft_write_data(value);
+}
+
+void lcd_power_set(int state){
+	int prev=lcd_power_state;
+
+	if (state==prev)
+		return;
+
+	/* set first, activity from now on queues a wake behind this call */
+	lcd_power_state=state;
+
+	if (prev==LCD_POWER_SLEEP || state==LCD_POWER_SLEEP){
+		uint32_t settled=(uint32_t)(Kernel::get_ms_count()-lcd_sleep_change_ms);
+		if (settled<LCD_SLEEP_SETTLE_MS)
+			ThisThread::sleep_for(LCD_SLEEP_SETTLE_MS-settled);
+	}
+
+	if (prev==LCD_POWER_SLEEP){
+		cy_tft_write_command(LCD_CMD_SLPOUT);
+		lcd_sleep_change_ms=Kernel::get_ms_count();
+		ThisThread::sleep_for(LCD_SLPOUT_DELAY_MS);
+	}
+
+	if (state==LCD_POWER_SLEEP){
+		cy_tft_write_command(LCD_CMD_DISPOFF);
+		cy_tft_write_command(LCD_CMD_SLPIN);
+		lcd_sleep_change_ms=Kernel::get_ms_count();
+	} else {
+		cy_tft_write_command(state==LCD_POWER_DIM ? LCD_CMD_IDMON : LCD_CMD_IDMOFF);
+		lcd_write_brightness(state==LCD_POWER_DIM ? LCD_BRIGHTNESS_DIM : LCD_BRIGHTNESS_ON);
+
+		/* the GRAM was kept, display on shows the picture */
+		if (prev==LCD_POWER_SLEEP)
+			cy_tft_write_command(LCD_CMD_DISPON);
+	}
+
+	uint64_t now=Kernel::get_ms_count();
+	uint32_t spent=(uint32_t)(now-lcd_power_since_ms);
+
+	lcd_power_time_ms[prev]+=spent;
+	lcd_power_since_ms=now;
+	APPLOG_INFO(LOG_LCD_POWER,(uint32_t)state,lcd_power_current_ua[state],spent,(uint32_t)prev);
+}
+
+void lcd_power_wake_thread(){
+	int prev=lcd_power_state;
+
+	core_util_atomic_store_bool(&lcd_wake_posted,false);
+	if (lcd_power_hold || prev==LCD_POWER_ON)
+		return;
+
+	lcd_power_set(LCD_POWER_ON);
+
+	if (prev==LCD_POWER_SLEEP){
+		uint32_t cycles=perf_cycles()-lcd_wake_start;
+
+		perf_stat_add(&lcd_wake_stat,cycles);
+		APPLOG_INFO(LOG_LCD_WAKE,perf_cycles_to_us(cycles));
+	}
+}
+
+void lcd_power_check(){
+	uint32_t activity=lcd_activity_ms;
+	uint32_t idle=(uint32_t)Kernel::get_ms_count()-activity;
+
+	if (!lcd_ready || lcd_power_hold)
+		return;
+
+	if (lcd_sleep_ms && idle>=lcd_sleep_ms)
+		lcd_power_set(LCD_POWER_SLEEP);
+	else if (lcd_dim_ms && idle>=lcd_dim_ms && lcd_power_state==LCD_POWER_ON)
+		lcd_power_set(LCD_POWER_DIM);
+
+	/* activity while the state was still on queued no wake */
+	if (lcd_activity_ms!=activity){
+		lcd_wake_start=perf_cycles();
+		lcd_power_wake_thread();
+	}
+}
+
+/* Estimated display current over the time spent per state */
+uint32_t lcd_power_average_ua(const uint64_t *power_ms){
+	uint64_t total=0;
+	uint64_t charge=0;
+
+	for (int i=0;i<LCD_POWER_STATES;i++){
+		total+=power_ms[i];
+		charge+=power_ms[i]*lcd_power_current_ua[i];
+	}
+	return total ? (uint32_t)(charge/total) : lcd_power_current_ua[LCD_POWER_ON];
+}
+
+void lcd_sleep_thread(){
+	lcd_power_hold=true;
+	lcd_power_set(LCD_POWER_SLEEP);
+}
 
+void lcd_wake_thread(){
+	lcd_power_hold=false;
+	lcd_activity_ms=(uint32_t)Kernel::get_ms_count();
+	lcd_power_wake_thread();
+}
+
+void lcd_sleep(){
+	lcd_queue.call(lcd_sleep_thread);
+}
+
+void lcd_wake(){
+	lcd_wake_start=perf_cycles();
+	lcd_queue.call(lcd_wake_thread);
+}
+
+
+void lcd_event_handler(const app_event_t *event){
+	switch(event->type){
+	case EVENT_BUTTON:
+		lcd_set_button_event(event->id,event->value,event);
+		break;
+	case EVENT_SLIDER:
+		lcd_show_slice_event(event->value,event);
+		break;
+	}
+}
+
+
+void lcd_cmd(int argc, char *argv[]){
+	if (argc>1 && !strcmp(argv[1],"bench")){
+		lcd_queue.call(lcd_bench_thread);
+		return;
+	} else if (argc>2 && !strcmp(argv[1],"fps")){
+		int fps=atoi(argv[2]);
+		if (fps>0 && fps<=1000)
+			lcd_frame_ms=1000/fps;
+	} else if (argc>2 && !strcmp(argv[1],"draw")){
+		for (int m=LCD_DRAW_DIRECT;m<=LCD_DRAW_SPRITE;m++){
+			if (!strcmp(argv[2],lcd_draw_mode_names[m]))
+				lcd_draw_mode=m;
+		}
+	} else if (argc>1 && !strcmp(argv[1],"drawbench")){
+		lcd_queue.call(lcd_draw_bench_thread);
+		return;
+	} else if (argc>1 && !strcmp(argv[1],"textbench")){
+		lcd_queue.call(lcd_text_bench_thread);
+		return;
+	} else if (argc>1 && !strcmp(argv[1],"console")){
+		char row[LCD_CONSOLE_ROW_MAX];
+
+		lcd_state_mutex.lock();
+		uint32_t count=lcd_state.console_count;
+		for (uint32_t n=count>LCD_CONSOLE_LINES ? count-LCD_CONSOLE_LINES : 0;n<count;n++){
+			lcd_console_format(&lcd_state.console[n%LCD_CONSOLE_LINES],row);
+			printf("%s\n",row);
+		}
+		lcd_state_mutex.unlock();
+		return;
+	} else if (argc>2 && !strcmp(argv[1],"rotate")){
+		lcd_queue.call(lcd_rotate_thread,atoi(argv[2])/90);
+		return;
+	} else if (argc>2 && !strcmp(argv[1],"init")){
+		char *name=strdup(argv[2]);
+		if (name && !lcd_queue.call(lcd_init_thread,(const char *)name))
+			free(name);
+		return;
+	} else if (argc>1 && !strcmp(argv[1],"latency")){
+		if (argc>2 && !strcmp(argv[2],"reset")){
+			for (int e=0;e<LCD_LATENCY_ELEMENTS;e++)
+				for (int i=0;i<LCD_LATENCY_STAGES;i++)
+					perf_stat_reset(&lcd_latency_stat[e][i]);
+			return;
+		}
+
+		char name[32];
+		for (int e=0;e<LCD_LATENCY_ELEMENTS;e++){
+			for (int i=0;i<LCD_LATENCY_STAGES;i++){
+				snprintf(name,sizeof(name),"%s %s",lcd_latency_element_names[e],lcd_latency_stage_names[i]);
+				perf_stat_print(name,&lcd_latency_stat[e][i]);
+			}
+		}
+		return;
+	} else if (argc>3 && !strcmp(argv[1],"idle")){
+		lcd_dim_ms=(uint32_t)atoi(argv[2])*1000u;
+		lcd_sleep_ms=(uint32_t)atoi(argv[3])*1000u;
+	} else if (argc>1 && !strcmp(argv[1],"fillbench")){
+		lcd_queue.call(lcd_fill_bench_thread);
+		return;
+	} else if (argc>1 && !strcmp(argv[1],"orientbench")){
+		lcd_queue.call(lcd_orient_bench_thread);
+		return;
+	} else if (argc>2 && !strcmp(argv[1],"shadow")){
+		LCD_X_SetShadowVerify(!strcmp(argv[2],"verify"));
+		return;
+	} else if (argc>1 && !strcmp(argv[1],"heap")){
+		if (argc>3 && !strcmp(argv[2],"soak")){
+			lcd_queue.call(lcd_heap_soak_thread,atoi(argv[3]));
+		} else if (argc>2 && !strcmp(argv[2],"on")){
+			lcd_heap_track=true;
+		} else if (argc>2 && !strcmp(argv[2],"off")){
+			lcd_heap_track=false;
+		} else if (argc>2 && !strcmp(argv[2],"reset")){
+			lcd_queue.call(lcd_heap_reset);
+		} else {
+			lcd_queue.call(lcd_heap_print);
+		}
+		return;
+	} else if (argc>1 && !strcmp(argv[1],"reset")){
+		perf_stat_reset(&lcd_frame_stat);
+		perf_stat_reset(&lcd_wake_stat);
+		memset(lcd_power_time_ms,0,sizeof(lcd_power_time_ms));
+		lcd_frame_missed=0;
+		memset(&lcd_render_stat,0,sizeof(lcd_render_stat));
+		memset(&lcd_stat_last,0,sizeof(lcd_stat_last));
+		return;
+	} else if (argc>2 && !strcmp(argv[1],"soak")){
+		mbed_stats_heap_t before;
+		mbed_stats_heap_t after;
+		int count=atoi(argv[2]);
+
+		mbed_stats_heap_get(&before);
+		for (int i=0;i<count;i++)
+			lcd_msg("soak %d",i);
+		mbed_stats_heap_get(&after);
+
+		/* all zero unless MBED_HEAP_STATS_ENABLED=1 */
+		printf("heap before: %lu after: %lu bytes\n",before.current_size,after.current_size);
+	}
+
+	lcd_render_stat_t stat=lcd_render_stat;
+	uint32_t bytes=LCD_X_GetBusBytes();
+	uint64_t now=Kernel::get_ms_count();
+	uint32_t elapsed=(uint32_t)(now-lcd_stat_last_ms);
+	uint64_t busy_us=lcd_frame_busy_us;
+
+	printf("frame cap: %lu ms (%lu fps), missed frames: %lu\n",lcd_frame_ms,1000/lcd_frame_ms,lcd_frame_missed);
+	perf_stat_print("frame",&lcd_frame_stat);
+	printf("renders: %lu redraws button: %lu slider: %lu console rows: %lu, unchanged rows skipped: %lu\n",
+			stat.renders,stat.buttons,stat.sliders,stat.rows,stat.rows_unchanged);
+	printf("console lines: %lu, scrolled out unshown: %lu\n",lcd_state.console_count,stat.console_unshown);
+	printf("draw: %s%s, memdev failed: %lu, bus bytes per update button: %lu slider: %lu\n",
+			lcd_draw_mode_names[lcd_draw_mode],lcd_sprites_ready?"":" (no sprites)",stat.memdev_failed,
+			stat.buttons?stat.button_bytes/stat.buttons:0,stat.sliders?stat.slider_bytes/stat.sliders:0);
+
+	U32 init_start,init_ready;
+	int variant;
+	LCD_X_GetInitTime(&init_start,&init_ready,&variant);
+	printf("display init %s: ready %lu ms after boot, init took %lu ms\n",LCD_X_GetInitVariant(variant),
+			init_ready,init_ready-init_start);
+
+	/* the current state counts up to now */
+	int power=lcd_power_state;
+	uint64_t power_ms[LCD_POWER_STATES];
+	memcpy(power_ms,lcd_power_time_ms,sizeof(power_ms));
+	power_ms[power]+=now-lcd_power_since_ms;
+	printf("display %s, dim after %lu s, sleep after %lu s, time on: %lu dim: %lu sleep: %lu s, average %lu uA\n",
+			lcd_power_names[power],lcd_dim_ms/1000,lcd_sleep_ms/1000,
+			(uint32_t)(power_ms[LCD_POWER_ON]/1000),(uint32_t)(power_ms[LCD_POWER_DIM]/1000),
+			(uint32_t)(power_ms[LCD_POWER_SLEEP]/1000),lcd_power_average_ua(power_ms));
+	perf_stat_print("wake to display on",&lcd_wake_stat);
+
+	U32 reads,read_bus,read_shadow,mismatch;
+	LCD_X_GetReadStat(&reads,&read_bus,&read_shadow,&mismatch);
+	printf("readbacks button: %lu slider: %lu console: %lu, all: %lu, bytes from bus: %lu from %d shadow tiles: %lu, verify mismatch: %lu\n",
+			stat.button_reads,stat.slider_reads,stat.row_reads,reads,read_bus,LCD_X_GetShadowTiles(),read_shadow,mismatch);
+
+	/* rates since the last "lcd stat", e.g. around a slider drag */
+	if (elapsed){
+		printf("last %lu ms: %lu renders/s %lu redraws/s %lu bus bytes/s\n",elapsed,
+				(uint32_t)((stat.renders-lcd_stat_last.renders)*1000ull/elapsed),
+				(uint32_t)((stat.buttons+stat.sliders+stat.rows-lcd_stat_last.buttons-lcd_stat_last.sliders-lcd_stat_last.rows)*1000ull/elapsed),
+				(uint32_t)((bytes-lcd_stat_last_bytes)*1000ull/elapsed));
+		printf("lcd_thread render cpu: %lu.%lu %%\n",
+				(uint32_t)((busy_us-lcd_stat_last_busy_us)/(elapsed*10ull)),
+				(uint32_t)((busy_us-lcd_stat_last_busy_us)/elapsed%10));
+	}
+
+	lcd_stat_last=stat;
+	lcd_stat_last_bytes=bytes;
+	lcd_stat_last_ms=now;
+	lcd_stat_last_busy_us=busy_us;
 }
 
 
 void lcd_StartUp(){
 
+	perf_init();
+	perf_stat_reset(&lcd_frame_stat);
+	perf_stat_reset(&lcd_wake_stat);
+	for (int e=0;e<LCD_LATENCY_ELEMENTS;e++)
+		for (int i=0;i<LCD_LATENCY_STAGES;i++)
+			perf_stat_reset(&lcd_latency_stat[e][i]);
+
 	lcd_thread.start(callback(&lcd_queue, &EventQueue::dispatch_forever));
 	 lcd_queue.call(lcd_startup_thread);
 
+	console_register("lcd", "stat|reset|fps <n>|draw direct|memdev|sprite|drawbench|textbench|orientbench|fillbench|rotate <deg>|init <variant>|idle <dim s> <sleep s>|latency [reset]|console|soak <n>|bench|heap [on|off|reset|soak <n>]|shadow verify|fast, frame, redraw and bus statistics", lcd_cmd);
+
+	eventbus_subscribe(&lcd_subscriber, EVENTBUS_TYPE(EVENT_BUTTON) | EVENTBUS_TYPE(EVENT_SLIDER),
+			EVENTBUS_TYPE(EVENT_SLIDER), lcd_event_handler, &lcd_queue);
+
 
 
 
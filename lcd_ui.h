@@ -8,6 +8,23 @@
 #define LCD_UI_H_
 
 #include "GUI.h"
+#include <stdio.h>
+
+/* Size of one console line of lcd_msg, longer text is cut */
+#define LCD_CONSOLE_COLS                        (64)
+
+/* Console lines kept, "lcd console" prints them */
+#define LCD_CONSOLE_LINES                       (16)
+
+/* Console rows above the slider, showing the latest lines */
+#define LCD_CONSOLE_ROWS                        (5)
+
+#define LCD_SLIDER_START_POS                    (180)
+
+/* Frame rate cap of the renderer, "lcd fps" changes it at run time */
+#ifndef LCD_FPS
+#define LCD_FPS                                 (30)
+#endif
 
 /**
  *
@@ -17,56 +34,67 @@
  */
 void lcd_StartUp(void);
 
+/**
+ *
+ * Wait until the display is initialized and shows the first frame,
+ * GUI_Init() runs in the lcd thread after lcd_StartUp() returned
+ *
+ */
+void lcd_wait_ready(void);
+
 
 
 
 
 
+/**
+ *
+ * Update the UI state, the lcd thread redraws what changed. Cheap, may be
+ * called at any rate.
+ *
+ */
 void lcd_show_button(int button_id);
 void lcd_close_button(int button_id);
 void lcd_show_slice(int pos);
-void lcd_draw_text(const char *text,int line);
-void lcd_draw_text_delay(const char *text,int line,int delay_ms);
-
-
 
 /**
  *
- * Display text message
+ * Append a line to the console, the rows scroll up. A line equal to the
+ * last one only counts up its repeat count.
  *
- * @param *format the formatted text
- * @param line the display time
- * @param formatted text arg
+ * @param text the text, copied
  *
  */
-template <typename... ArgTs>
-void lcd_msg(const char *format,int line, ArgTs... args ) {
+void lcd_console_write(const char *text);
 
-		char* buffer = new char[128];
-		sprintf(buffer,format,args...);
+/**
+ *
+ * Switch display off and put the controller into sleep, the GRAM content
+ * is retained so lcd_wake() shows the same picture without redraw. The
+ * display stays off until lcd_wake(), the idle policy, which dims and
+ * sleeps the display by itself, does not wake it.
+ *
+ */
+void lcd_sleep(void);
+void lcd_wake(void);
 
-		lcd_draw_text(buffer,line);
 
-}
 
 /**
  *
- * Display text message period of time
+ * Display text message on the console
  *
  * @param *format the formatted text
- * @param line the display time
- * @param close_ms time of display
  * @param formatted text arg
  *
  */
-
 template <typename... ArgTs>
-void lcd_msg_delay_close(const char *format,int line,int close_ms, ArgTs... args ) {
-
+void lcd_msg(const char *format, ArgTs... args ) {
 
-		lcd_msg(format,line,args...);
-		lcd_draw_text_delay("",line,close_ms);
+		char buffer[LCD_CONSOLE_COLS];
+		snprintf(buffer,sizeof(buffer),format,args...);
 
+		lcd_console_write(buffer);
 
 }
 
@@ -74,11 +102,4 @@ void lcd_msg_delay_close(const char *format,int line,int close_ms, ArgTs... args
 
 
 
-#define APP_INFO( x )                        printf x
-
-
-
-
-
-
 #endif /* LCD_UI_H_ */
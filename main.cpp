@@ -27,6 +27,11 @@
 #include "mbed_memory_status.h"
 #include "capsense.h"
 #include "lcd_ui.h"
+#include "applog.h"
+#include "eventbus.h"
+#include "console.h"
+#include "power.h"
+#include "boot.h"
 #include "cy_smif.h"
 #include "cy_smif_memslot.h"
 #include "cycfg_qspi_memslot.h"
@@ -122,72 +127,105 @@ void busy_thread()
 
 
 
-int main()
-{
-
-
-#if defined(HW_STATS)
-
-	   EventQueue *stats_queue = mbed_event_queue();
-	    Thread *thread;
-	    int id;
-
-	    id = stats_queue->call_every(HW_STATS_SAMPLE_TIME, hw_stats);
-	    thread = new Thread(osPriorityNormal, HW_STATS_MAX_THREAD_STACK);
-	    thread->start(busy_thread);
-#endif
-
-
-
-
-
-
-
-
-
-
-   initNetworkInterface();
-
-   lcd_StartUp();
-
-   capsense_init();
-
-
-   lcd_msg("START DEVICES...",0);
-
-   lcd_msg_delay_close("Mbed: %d.%d.%d",2,1000,MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
-
-
-
-
-
-
-
-
-
+/*
+ * Boot graph, a stage starts once its dependencies are done, the order is
+ * the priority among the ready ones. The display and touch do not wait for
+ * the network, the Wi-Fi join runs in the background after its stage.
+ */
+enum {
+	BOOT_APPLOG,
+	BOOT_EVENTBUS,
+	BOOT_LCD,
+	BOOT_CAPSENSE,
+	BOOT_CONSOLE,
+	BOOT_NETWORK,
+	BOOT_POWER,
+	BOOT_BANNER,
+	BOOT_AWS,
+	BOOT_STAGES
+};
+
+static int boot_applog(void){
+	applog_init();
+	return 0;
+}
 
+static int boot_eventbus(void){
+	eventbus_init();
+	return 0;
+}
 
-    if (!get_network_interface())
-   	 return 1;
+/* Done when the first frame is on the display */
+static int boot_lcd(void){
+	lcd_StartUp();
+	lcd_wait_ready();
+	return 0;
+}
 
+static int boot_console(void){
+	console_init();
+	return 0;
+}
 
+static int boot_network(void){
+	initNetworkInterface();
+	if (!get_network_interface())
+		return -1;
 
-  network_connect();
+	/* Returns at once, AWS connects on link up */
+	network_connect();
+	return 0;
+}
 
+static int boot_power(void){
+	power_init();
+	return 0;
+}
 
+static int boot_banner(void){
+	lcd_msg("START DEVICES...");
+	lcd_msg("Mbed: %d.%d.%d",MBED_MAJOR_VERSION, MBED_MINOR_VERSION, MBED_PATCH_VERSION);
+	return 0;
+}
 
+static int boot_aws(void){
+	awsiot_start(get_network_interface());
+	return 0;
+}
 
+const boot_stage_t boot_stages[BOOT_STAGES] = {
+	{ "applog",   0,                                              boot_applog },
+	{ "eventbus", 0,                                              boot_eventbus },
+	{ "lcd",      BOOT_DEP(BOOT_EVENTBUS),                        boot_lcd },
+	{ "capsense", BOOT_DEP(BOOT_EVENTBUS),                        capsense_init },
+	{ "console",  0,                                              boot_console },
+	{ "network",  BOOT_DEP(BOOT_EVENTBUS),                        boot_network },
+	{ "power",    BOOT_DEP(BOOT_LCD) | BOOT_DEP(BOOT_CAPSENSE),   boot_power },
+	{ "banner",   BOOT_DEP(BOOT_LCD),                             boot_banner },
+	{ "aws",      BOOT_DEP(BOOT_NETWORK),                         boot_aws },
+};
 
 
+int main()
+{
+   boot_mark("main");
 
-  if (!awsiot_connect(get_network_interface()))
-	  return -1;
+#if defined(HW_STATS)
 
+	   EventQueue *stats_queue = mbed_event_queue();
+	    Thread *thread;
+	    int id;
 
+	    id = stats_queue->call_every(HW_STATS_SAMPLE_TIME, hw_stats);
+	    thread = new Thread(osPriorityNormal, HW_STATS_MAX_THREAD_STACK);
+	    thread->start(busy_thread);
+#endif
 
- wait_us(osWaitForever);
 
+   /* A failed stage only skips the stages depending on it */
+   boot_run(boot_stages, BOOT_STAGES);
 
 
+ ThisThread::sleep_for(osWaitForever);
 
 }
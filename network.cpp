@@ -11,8 +11,82 @@
 #include "network.h"
 
 #include "lcd_ui.h"
+#include "applog.h"
+#include "console.h"
+#include "eventbus.h"
+#include "boot.h"
 #include "mbed.h"
 #include "whdstainterface.h"
+#include "kvstore_global_api.h"
+
+#include <string.h>
+#include <algorithm>
+
+
+/* Access point of the last successful connect, joined first without a scan */
+#define NETWORK_AP_KEY                          "/kv/net_ap"
+#define NETWORK_AP_VERSION                      (1u)
+
+/* Results kept of a scan, the strongest access point of WIFI_SSID is joined */
+#define NETWORK_SCAN_MAX                        (16)
+
+/* Failed attempts before the failure is shown, the retries go on */
+#define NETWORK_CONNECT_TRIES                   (3)
+
+/* Delay before the next attempt, doubled after each failed one */
+#define NETWORK_RETRY_MIN_MS                    (2000u)
+#define NETWORK_RETRY_MAX_MS                    (60000u)
+
+/*
+ * Connection state machine, run by the network thread. network_connect()
+ * only asks for the link, the thread joins in the background and retries
+ * until it is up. The status callback of the interface reports a lost
+ * link, which is joined again. Link changes are published as EVENT_LINK.
+ */
+#define NETWORK_STATE_IDLE                      (0)
+#define NETWORK_STATE_CONNECTING                (1)
+#define NETWORK_STATE_UP                        (2)
+#define NETWORK_STATE_RETRY                     (3)
+
+#define NETWORK_WARM                            (0)
+#define NETWORK_COLD                            (1)
+
+typedef struct {
+	uint8_t version;
+	uint8_t channel;
+	uint8_t security;
+	uint8_t bssid[6];
+	char ssid[33];
+} network_ap_t;
+
+/* Connect to IP address time */
+typedef struct {
+	uint32_t count;
+	uint32_t last_ms;
+	uint32_t max_ms;
+	uint64_t sum_ms;
+} network_connect_stat_t;
+
+const char *network_connect_names[] = { "warm", "cold" };
+network_connect_stat_t network_connect_stat[2];
+uint32_t network_warm_failed = 0;
+
+WiFiAccessPoint network_scan_result[NETWORK_SCAN_MAX];
+
+const char *network_state_names[] = { "idle", "connecting", "up", "retry" };
+
+/* A join blocks for seconds, only this thread waits for it */
+Thread network_thread(osPriorityBelowNormal, 4096, NULL, "network_thread");
+EventQueue network_queue(8 * EVENTS_EVENT_SIZE);
+
+volatile int network_state = NETWORK_STATE_IDLE;
+int network_retry_event_id = 0;
+uint32_t network_retry_ms = NETWORK_RETRY_MIN_MS;
+uint32_t network_attempts = 0;
+uint32_t network_link_lost = 0;
+
+/* Start of the current connect, for the time to ip address */
+uint64_t network_connect_start = 0;
 
 
 
@@ -24,13 +98,35 @@ WhdSTAInterface  *network_interface;
 
 
 
+static void network_stop_thread(void){
+	bool was_up = network_state == NETWORK_STATE_UP;
+
+	if (network_retry_event_id){
+		network_queue.cancel(network_retry_event_id);
+		network_retry_event_id = 0;
+	}
+
+	network_state = NETWORK_STATE_IDLE;
+	network_interface->disconnect();
+
+	if (was_up)
+		eventbus_publish(EVENT_LINK, 0, 0);
+}
+
+
 void network_disconnect( void ){
 	if (!network_interface)
 		return;
-	network_interface->disconnect();
 
-	network_interface = NULL;
-	return;
+	network_queue.call(network_stop_thread);
+}
+
+
+void network_suspend( void ){
+	if (!network_interface)
+		return;
+
+	network_queue.call(network_stop_thread);
 }
 
 
@@ -38,115 +134,257 @@ WhdSTAInterface* get_network_interface(){
 	return network_interface;
 }
 
-void initNetworkInterface(){
-	network_interface = new WhdSTAInterface();
-//	network_interface->get_emac().power_down();
-//	network_interface->get_emac().power_up();
-//	network_interface->get_emac().power_down();
 
+static bool network_ap_load(network_ap_t *ap){
+	size_t size = 0;
 
-	if (!network_interface){
-		APP_INFO(("ERROR: No WiFiInterface found.\n"));
+	if (kv_get(NETWORK_AP_KEY, ap, sizeof(network_ap_t), &size) != MBED_SUCCESS || size != sizeof(network_ap_t))
+		return false;
+
+	return ap->version == NETWORK_AP_VERSION && !strcmp(ap->ssid, WIFI_SSID);
+}
+
+/* Written only when the access point changed, to spare the flash */
+static void network_ap_save(WiFiAccessPoint *found){
+	network_ap_t ap;
+	network_ap_t stored;
+
+	memset(&ap, 0, sizeof(ap));
+	ap.version = NETWORK_AP_VERSION;
+	ap.channel = found->get_channel();
+	ap.security = found->get_security();
+	memcpy(ap.bssid, found->get_bssid(), sizeof(ap.bssid));
+	strncpy(ap.ssid, found->get_ssid(), sizeof(ap.ssid) - 1);
+
+	if (network_ap_load(&stored) && !memcmp(&ap, &stored, sizeof(ap)))
 		return;
+
+	kv_set(NETWORK_AP_KEY, &ap, sizeof(ap), 0);
+}
+
+
+/* WHD joins by SSID, a channel the driver can not pin is ignored */
+static nsapi_error_t network_join(nsapi_security_t security, uint8_t channel){
+	network_interface->set_credentials(WIFI_SSID, WIFI_PASSWORD, security);
+	network_interface->set_channel(channel);
+
+	return network_interface->connect();
+}
+
+/* One scan, then a join of the strongest access point of WIFI_SSID */
+static nsapi_error_t network_join_scanned(WiFiAccessPoint **joined){
+	WiFiAccessPoint *best = NULL;
+	int numofwifi = network_interface->scan(network_scan_result, NETWORK_SCAN_MAX);
+
+	if (numofwifi > NETWORK_SCAN_MAX)
+		numofwifi = NETWORK_SCAN_MAX;
+
+	lcd_msg("num of wifi: %d", numofwifi);
+
+	for (int i = 0; i < numofwifi; i++){
+		if (strcmp(network_scan_result[i].get_ssid(), WIFI_SSID))
+			continue;
+
+		if (!best || network_scan_result[i].get_rssi() > best->get_rssi())
+			best = &network_scan_result[i];
 	}
 
+	if (!best)
+		return NSAPI_ERROR_NO_SSID;
+
+	*joined = best;
+	return network_join(best->get_security(), best->get_channel());
+}
 
-	//network_interface->scan(NULL,0);
 
-	//network_interface->disconnect();
+static void network_connect_done(int kind, uint32_t ms){
+	network_connect_stat_t *stat = &network_connect_stat[kind];
 
+	stat->count++;
+	stat->last_ms = ms;
+	stat->sum_ms += ms;
+	if (ms > stat->max_ms)
+		stat->max_ms = ms;
 }
 
 
- void network_connect( void ){
+static void network_attempt(void){
+	network_ap_t ap;
+	WiFiAccessPoint *joined = NULL;
+	SocketAddress address;
+	nsapi_error_t net_status;
+	bool warm;
 
+	network_retry_event_id = 0;
+	if (network_state != NETWORK_STATE_CONNECTING && network_state != NETWORK_STATE_RETRY)
+		return;
 
-	 if (!network_interface)
-		 return;
+	network_state = NETWORK_STATE_CONNECTING;
+	network_attempts++;
 
-    SocketAddress address;
-    cy_rslt_t result = CY_RSLT_SUCCESS;
-    //LCD_MSG("Connecting Wifi",0);
+	/* The first join includes the WHD firmware download */
+	boot_mark("wifi start");
 
+	/* The stored access point first, scans after it failed */
+	warm = network_attempts == 1 && network_ap_load(&ap);
+	if (warm)
+		net_status = network_join((nsapi_security_t)ap.security, ap.channel);
+	else
+		net_status = network_join_scanned(&joined);
 
-    if (network_interface->get_connection_status() != NSAPI_STATUS_DISCONNECTED)
-        {
-    	 APP_INFO(( "WIFI is connected\r\n" ));
-            return;
-        }
+	if (net_status != NSAPI_ERROR_OK){
+		APPLOG_WARN(LOG_NET_RETRY, net_status);
 
+		if (warm){
+			network_warm_failed++;
+			network_queue.call(network_attempt);
+			return;
+		}
 
-    APP_INFO(( "Connecting to the network using Wifi...\r\n" ));
+		if (network_attempts == NETWORK_CONNECT_TRIES){
+			lcd_msg("No Wifi, %d", net_status);
+			APPLOG_ERROR(LOG_NET_FAILED, net_status);
+		}
 
+		network_state = NETWORK_STATE_RETRY;
+		network_retry_event_id = network_queue.call_in(network_retry_ms, network_attempt);
+		network_retry_ms = std::min<uint32_t>(network_retry_ms * 2, NETWORK_RETRY_MAX_MS);
+		return;
+	}
 
-   // network_interface->set_default_parameters();
+	network_interface->get_ip_address(&address);
+	boot_mark("wifi ip");
 
+	uint32_t ms = (uint32_t)(Kernel::get_ms_count() - network_connect_start);
+	int kind = warm ? NETWORK_WARM : NETWORK_COLD;
 
+	network_connect_done(kind, ms);
+	if (joined)
+		network_ap_save(joined);
 
+	network_state = NETWORK_STATE_UP;
+	network_retry_ms = NETWORK_RETRY_MIN_MS;
 
+	lcd_msg("IP: %s ", address.get_ip_address());
+	APPLOG_INFO(LOG_NET_CONNECTED, address.get_ip_address());
+	APPLOG_INFO(LOG_NET_CONNECT_TIME, ms, (uint32_t)kind, network_attempts);
 
-    nsapi_error_t net_status = -1;
-    for ( int tries = 0; tries < 3; tries++ )
-    {
+	eventbus_publish(EVENT_LINK, 0, 1);
+}
 
+static void network_begin(void){
+	network_state = NETWORK_STATE_CONNECTING;
+	network_attempts = 0;
+	network_retry_ms = NETWORK_RETRY_MIN_MS;
+	network_connect_start = Kernel::get_ms_count();
+	network_attempt();
+}
 
 
-        int numofwifi = network_interface->scan(NULL, 0);
+static void network_connect_thread(void){
+	if (network_state != NETWORK_STATE_IDLE)
+		return;
 
-        if (numofwifi>10)
-        	numofwifi=10;
+	if (network_interface->get_connection_status() == NSAPI_STATUS_GLOBAL_UP){
+		APPLOG_INFO(LOG_NET_ALREADY_CONNECTED);
+		network_state = NETWORK_STATE_UP;
+		eventbus_publish(EVENT_LINK, 0, 1);
+		return;
+	}
 
+	APPLOG_INFO(LOG_NET_CONNECTING);
+	network_begin();
+}
 
-        lcd_msg("num of wifi: %d",1,numofwifi);
+/*
+ * Joins report their own result, only a change of an up link counts.
+ * Statuses raised during a join are queued behind it, so the link is
+ * judged by its state now, not by the status that was queued.
+ */
+static void network_status_thread(void){
+	if (network_state != NETWORK_STATE_UP)
+		return;
 
-        WiFiAccessPoint* wifipoint = new WiFiAccessPoint[numofwifi];
+	nsapi_connection_status_t status = network_interface->get_connection_status();
 
+	if (status == NSAPI_STATUS_GLOBAL_UP || status == NSAPI_STATUS_LOCAL_UP)
+		return;
 
+	network_link_lost++;
+	lcd_msg("Wifi lost");
+	APPLOG_WARN(LOG_NET_LINK_LOST, (uint32_t)status);
+	eventbus_publish(EVENT_LINK, 0, 0);
 
-        network_interface->scan(wifipoint, numofwifi);
+	/* reset the interface state before joining again */
+	network_state = NETWORK_STATE_RETRY;
+	network_interface->disconnect();
+	network_begin();
+}
 
-        for(int i=0;i<numofwifi;i++){
-        	if (strcmp(wifipoint[i].get_ssid(),WIFI_SSID))
-        			continue;
+/* Called from the driver, handed over to the network thread */
+static void network_status_changed(nsapi_event_t event, intptr_t value){
+	if (event == NSAPI_EVENT_CONNECTION_STATUS_CHANGE)
+		network_queue.call(network_status_thread);
+}
 
-        	  network_interface->set_credentials(WIFI_SSID,WIFI_PASSWORD , NSAPI_SECURITY_WPA_WPA2);
 
+static void network_cmd(int argc, char *argv[]){
+	network_ap_t ap;
 
+	if (argc > 1 && !strcmp(argv[1], "forget")){
+		kv_remove(NETWORK_AP_KEY);
+		return;
+	}
 
-        	  break;
-        }
+	printf("state: %s, attempts: %lu, link lost: %lu\n", network_state_names[network_state],
+			network_attempts, network_link_lost);
 
+	if (network_ap_load(&ap))
+		printf("stored ap: %s %02x:%02x:%02x:%02x:%02x:%02x channel %u security %u\n", ap.ssid,
+				ap.bssid[0], ap.bssid[1], ap.bssid[2], ap.bssid[3], ap.bssid[4], ap.bssid[5],
+				ap.channel, ap.security);
+	else
+		printf("no stored ap\n");
 
+	for (int kind = NETWORK_WARM; kind <= NETWORK_COLD; kind++){
+		network_connect_stat_t *stat = &network_connect_stat[kind];
+
+		printf("%s connect to ip n: %lu last: %lu avg: %lu max: %lu ms\n", network_connect_names[kind],
+				stat->count, stat->last_ms, stat->count ? (uint32_t)(stat->sum_ms / stat->count) : 0u,
+				stat->max_ms);
+	}
+	printf("warm connect failed: %lu\n", network_warm_failed);
+}
 
 
+void initNetworkInterface(){
+	network_interface = new WhdSTAInterface();
+//	network_interface->get_emac().power_down();
+//	network_interface->get_emac().power_up();
+//	network_interface->get_emac().power_down();
 
 
-        net_status = network_interface->connect();
-        if ( net_status == NSAPI_ERROR_OK )
-        {
+	if (!network_interface){
+		APPLOG_ERROR(LOG_NET_NO_INTERFACE);
+		return;
+	}
 
-            break;
-        }
-        else
-        {
+	network_interface->attach(callback(network_status_changed));
+	network_thread.start(callback(&network_queue, &EventQueue::dispatch_forever));
 
-        //	LCD_MSG("Retry Wifi %i",tries);
-            APP_INFO(( "Unable to connect to network. Retrying...\r\n" ));
-        }
-    }
+	console_register("net", "stat|forget, Wi-Fi link state, connect time and the stored access point", network_cmd);
 
-    if ( net_status != NSAPI_ERROR_OK )
-    {
-    	lcd_msg("No Wifi, %d", net_status);
-        APP_INFO(( "ERROR: Connecting to the network failed (%d)!\r\n", net_status ));
-        network_interface = NULL;
-        return ;
-    }
+}
 
-    network_interface->get_ip_address(&address);
-    lcd_msg("IP: %s ",1,address.get_ip_address() );
-    APP_INFO(( "Connected to the network successfully. IP address: %s\n", address.get_ip_address() ));
 
-	return ;
+/*
+ * A warm connect joins the access point stored by the last successful
+ * connect, without a scan. A cold connect, on the first boot or after the
+ * warm one failed, scans and stores the access point it joined.
+ */
+void network_connect( void ){
+	if (!network_interface)
+		return;
 
+	network_queue.call(network_connect_thread);
 }
@@ -30,7 +30,9 @@ void initNetworkInterface();
 
 /**
  *
- * Connect to network
+ * Connect to network in the background, returns at once. EVENT_LINK is
+ * published when the link is up and when it goes down, a lost link is
+ * joined again until network_suspend()
  *
  */
 void network_connect( void );
@@ -41,6 +43,13 @@ void network_connect( void );
  */
 void network_disconnect( void );
 
+/**
+ *
+ * Disconnect from the access point and stop reconnecting, but keep the
+ * interface, so network_connect() can connect again
+ */
+void network_suspend( void );
+
 /**
  *
  *
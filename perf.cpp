@@ -0,0 +1,75 @@
+/*
+ * perf.cpp
+ *
+ *  Cycle counter timestamps and statistics, see perf.h
+ *
+ *      Author: sc lee
+ *
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#include "perf.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+void perf_init(void)
+{
+	if (DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)
+		return;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
+void perf_stat_add(perf_stat_t *stat, uint32_t cycles)
+{
+	uint32_t us = perf_cycles_to_us(cycles);
+	int bucket = us ? 32 - __CLZ(us) : 0;
+
+	if (bucket >= PERF_HIST_BUCKETS)
+		bucket = PERF_HIST_BUCKETS - 1;
+
+	if (!stat->count || cycles < stat->min)
+		stat->min = cycles;
+	if (cycles > stat->max)
+		stat->max = cycles;
+
+	stat->count++;
+	stat->sum += cycles;
+	stat->hist[bucket]++;
+}
+
+void perf_stat_reset(perf_stat_t *stat)
+{
+	memset(stat, 0, sizeof(perf_stat_t));
+}
+
+uint32_t perf_stat_avg_us(const perf_stat_t *stat)
+{
+	if (!stat->count)
+		return 0;
+
+	return perf_cycles_to_us((uint32_t)(stat->sum / stat->count));
+}
+
+
+void perf_stat_print(const char *name, const perf_stat_t *stat)
+{
+	printf("%-10s n: %lu min: %lu avg: %lu max: %lu us\n", name, stat->count,
+			perf_cycles_to_us(stat->min), perf_stat_avg_us(stat), perf_cycles_to_us(stat->max));
+
+	if (!stat->count)
+		return;
+
+	printf("%-10s", "");
+	for (int i = 0; i < PERF_HIST_BUCKETS; i++) {
+		if (stat->hist[i])
+			printf(" <%luus:%lu", 1ul << i, stat->hist[i]);
+	}
+	printf("\n");
+}
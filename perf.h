@@ -0,0 +1,96 @@
+/*
+ * perf.h
+ *
+ *  Cycle counter timestamps and min/avg/max/histogram statistics
+ *
+ *  Timestamps are read from the DWT cycle counter of the CM4, which wraps
+ *  after 2^32 cycles (about 29 s at 144 MHz), so only intervals shorter
+ *  than that are meaningful.
+ *
+ *      Author: sc lee
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdint.h>
+#include "cy_pdl.h"
+
+/*
+ * Histogram bucket n counts samples of [2^(n-1), 2^n) us, bucket 0 counts
+ * samples below 1 us and the last bucket everything above.
+ */
+#define PERF_HIST_BUCKETS                       (16)
+
+typedef struct {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[PERF_HIST_BUCKETS];
+} perf_stat_t;
+
+
+/**
+ *
+ * Enable the cycle counter, safe to call more than once
+ *
+ */
+void perf_init(void);
+
+/**
+ *
+ * Read the cycle counter
+ *
+ */
+static inline uint32_t perf_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+/**
+ *
+ * Convert cycles into microseconds
+ *
+ */
+static inline uint32_t perf_cycles_to_us(uint32_t cycles)
+{
+	return cycles / (SystemCoreClock / 1000000u);
+}
+
+/**
+ *
+ * Add one sample to the statistic
+ *
+ * @param stat the statistic
+ * @param cycles the sample in cycles
+ *
+ */
+void perf_stat_add(perf_stat_t *stat, uint32_t cycles);
+
+/**
+ *
+ * Clear the statistic
+ *
+ */
+void perf_stat_reset(perf_stat_t *stat);
+
+/**
+ *
+ * Average of the samples in microseconds
+ *
+ */
+uint32_t perf_stat_avg_us(const perf_stat_t *stat);
+
+/**
+ *
+ * Print min/avg/max in microseconds and the non empty histogram buckets
+ *
+ * @param name the label of the line
+ * @param stat the statistic
+ *
+ */
+void perf_stat_print(const char *name, const perf_stat_t *stat);
+
+#endif /* PERF_H_ */
@@ -0,0 +1,199 @@
+/*
+ * power.cpp
+ *
+ *  Wake-on-touch low power mode, see power.h
+ *
+ *      Author: sc lee
+ *
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#include "power.h"
+
+#include "mbed.h"
+#include "capsense.h"
+#include "lcd_ui.h"
+#include "network.h"
+#include "awsiot.h"
+#include "console.h"
+#include "applog.h"
+
+#include <string.h>
+
+
+#define POWER_CHECK_PERIOD_MS                   (1000u)
+
+/* The log only needs to be drained now and then while sleeping */
+#define POWER_SLEEP_DRAIN_PERIOD_MS             (5000u)
+
+
+/*
+ * The thread only starts the wake up sequence, the Wi-Fi join runs in the
+ * network thread and the TLS handshake in the awsiot thread on link up.
+ */
+Thread power_thread(osPriorityBelowNormal, 1024, NULL, "power_thread");
+EventQueue power_queue;
+
+int power_check_event_id = 0;
+bool power_auto_sleep = true;
+volatile bool power_sleeping = false;
+volatile bool power_wait_publish = false;
+/* Written from other threads, 32 bit for single accesses, compared wrap safe */
+volatile uint32_t power_last_activity_ms = 0;
+volatile uint32_t power_wake_ms = 0;
+
+/* Wake to first publish latency */
+typedef struct {
+	uint32_t count;
+	uint32_t last_ms;
+	uint32_t max_ms;
+	uint64_t sum_ms;
+	uint32_t over_budget;
+} power_wake_stat_t;
+
+power_wake_stat_t power_wake_stat;
+
+#if MBED_CPU_STATS_ENABLED
+mbed_stats_cpu_t power_cpu_last;
+#endif
+
+
+
+void power_activity(void){
+	power_last_activity_ms = (uint32_t)Kernel::get_ms_count();
+}
+
+
+static void power_sleep_thread(void){
+	if (power_sleeping)
+		return;
+
+	power_sleeping = true;
+	power_wait_publish = false;
+
+	if (power_check_event_id){
+		power_queue.cancel(power_check_event_id);
+		power_check_event_id = 0;
+	}
+
+	APPLOG_INFO(LOG_POWER_SLEEP, (uint32_t)Kernel::get_ms_count() - power_last_activity_ms);
+
+	capsense_low_power(true);
+	lcd_sleep();
+	awsiot_suspend();
+	network_suspend();
+
+	console_enable_input(false);
+	applog_set_drain_period(POWER_SLEEP_DRAIN_PERIOD_MS);
+}
+
+
+static void power_check(void){
+	if (!power_auto_sleep || power_sleeping || !capsense_can_sleep())
+		return;
+
+	if ((uint32_t)Kernel::get_ms_count() - power_last_activity_ms > POWER_IDLE_TIMEOUT_MS)
+		power_sleep_thread();
+}
+
+
+static void power_wake_thread(void){
+	if (!power_sleeping)
+		return;
+
+	power_sleeping = false;
+	power_activity();
+
+	applog_set_drain_period(APPLOG_DRAIN_PERIOD_MS);
+	console_enable_input(true);
+	APPLOG_INFO(LOG_POWER_WAKE);
+
+	lcd_wake();
+
+	/* The publish after reconnect stops the clock started by power_wake() */
+	power_wait_publish = true;
+	network_connect();
+
+	power_check_event_id = power_queue.call_every(POWER_CHECK_PERIOD_MS, power_check);
+}
+
+void power_wake(void){
+	if (!power_sleeping)
+		return;
+
+	power_wake_ms = (uint32_t)Kernel::get_ms_count();
+	power_queue.call(power_wake_thread);
+}
+
+
+static void power_published(void){
+	if (!power_wait_publish)
+		return;
+
+	power_wait_publish = false;
+
+	uint32_t latency = (uint32_t)Kernel::get_ms_count() - power_wake_ms;
+
+	power_wake_stat.count++;
+	power_wake_stat.last_ms = latency;
+	power_wake_stat.sum_ms += latency;
+	if (latency > power_wake_stat.max_ms)
+		power_wake_stat.max_ms = latency;
+	if (latency > POWER_WAKE_PUBLISH_BUDGET_MS)
+		power_wake_stat.over_budget++;
+
+	APPLOG_INFO(LOG_POWER_WAKE_PUBLISH, latency);
+}
+
+
+/*
+ * Share of the time spent in the idle thread since the previous call
+ */
+static void power_print_cpu(void){
+#if MBED_CPU_STATS_ENABLED
+	mbed_stats_cpu_t cpu;
+
+	mbed_stats_cpu_get(&cpu);
+
+	uint64_t uptime = cpu.uptime - power_cpu_last.uptime;
+	uint64_t idle = cpu.idle_time - power_cpu_last.idle_time;
+	uint64_t sleep = (cpu.sleep_time - power_cpu_last.sleep_time) + (cpu.deep_sleep_time - power_cpu_last.deep_sleep_time);
+
+	if (uptime)
+		printf("cpu idle: %lu%%, sleep: %lu%% over %lu ms\n", (uint32_t)(idle * 100 / uptime),
+				(uint32_t)(sleep * 100 / uptime), (uint32_t)(uptime / 1000));
+
+	power_cpu_last = cpu;
+#else
+	printf("cpu stats disabled, MBED_CPU_STATS_ENABLED=0\n");
+#endif
+}
+
+
+static void power_cmd(int argc, char *argv[]){
+	if (argc > 1 && !strcmp(argv[1], "sleep")){
+		power_queue.call(power_sleep_thread);
+	} else if (argc > 1 && !strcmp(argv[1], "on")){
+		power_auto_sleep = true;
+	} else if (argc > 1 && !strcmp(argv[1], "off")){
+		power_auto_sleep = false;
+	} else {
+		printf("auto sleep: %s, %s, idle timeout %u ms\n", power_auto_sleep ? "on" : "off",
+				power_sleeping ? "sleeping" : "awake", POWER_IDLE_TIMEOUT_MS);
+		printf("wake to publish n: %lu last: %lu avg: %lu max: %lu ms, over %u ms: %lu\n",
+				power_wake_stat.count, power_wake_stat.last_ms,
+				power_wake_stat.count ? (uint32_t)(power_wake_stat.sum_ms / power_wake_stat.count) : 0u,
+				power_wake_stat.max_ms, POWER_WAKE_PUBLISH_BUDGET_MS, power_wake_stat.over_budget);
+		power_print_cpu();
+	}
+}
+
+
+void power_init(void){
+	power_activity();
+	awsiot_attach_publish(power_published);
+	console_register("power", "on|off|sleep|stat, wake-on-touch low power mode", power_cmd);
+
+	power_thread.start(callback(&power_queue, &EventQueue::dispatch_forever));
+	power_check_event_id = power_queue.call_every(POWER_CHECK_PERIOD_MS, power_check);
+}
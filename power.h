@@ -0,0 +1,50 @@
+/*
+ * power.h
+ *
+ *  Wake-on-touch low power mode
+ *
+ *  After POWER_IDLE_TIMEOUT_MS without touch, the display and Wi-Fi are
+ *  switched off, the serial receiver is stopped and CapSense scans only
+ *  the wake widget at a slow rate, so the device
+ *  sleeps between scans. A touch on the wake widget brings everything back
+ *  and the time from the touch to the first successful publish is measured.
+ *
+ *      Author: sc lee
+ *  Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#ifndef POWER_IDLE_TIMEOUT_MS
+#define POWER_IDLE_TIMEOUT_MS                   (60000u)
+#endif
+
+/* Wake to first publish above this is counted as over budget */
+#ifndef POWER_WAKE_PUBLISH_BUDGET_MS
+#define POWER_WAKE_PUBLISH_BUDGET_MS            (15000u)
+#endif
+
+/**
+ *
+ * Start the power management thread
+ *
+ */
+void power_init(void);
+
+/**
+ *
+ * Report user activity, restarts the idle timeout. Cheap enough for the
+ * scan thread.
+ *
+ */
+void power_activity(void);
+
+/**
+ *
+ * Wake up the system from low power mode, called on touch of the wake widget
+ *
+ */
+void power_wake(void);
+
+#endif /* POWER_H_ */
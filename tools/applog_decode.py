@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# applog_decode.py
+#
+#  Decode the "@L" records drained by applog.cpp back into text.
+#
+#  Usage:
+#    applog_decode.py [capture.txt]          decode a serial capture (or stdin)
+#    applog_decode.py -p /dev/ttyACM0        decode live from the serial port
+#
+#  Lines which are not log records are passed through unchanged.
+#
+#      Author: sc lee
+#  Licensed under the Apache License, Version 2.0
+#
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+FLAG_STRING = 0x80
+
+MSG_RE = re.compile(r'APPLOG_MSG\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+SPEC_RE = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diuxXcsp%])')
+
+
+def load_messages(path):
+    with open(path) as f:
+        text = f.read()
+    # drop comments so commented out entries do not shift the IDs
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    text = re.sub(r'//[^\n]*', '', text)
+    return [(name, bytes(fmt, "utf-8").decode("unicode_escape"))
+            for name, fmt in MSG_RE.findall(text)]
+
+
+def to_signed(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def format_message(fmt, args, string_arg):
+    it = iter(args)
+
+    def conv(m):
+        flags, _, kind = m.groups()
+        if kind == '%':
+            return '%'
+        if kind == 's':
+            return ('%' + flags + 's') % string_arg
+        value = next(it, 0)
+        if kind in 'di':
+            return ('%' + flags + 'd') % to_signed(value)
+        if kind == 'p':
+            return '0x%08x' % value
+        if kind == 'c':
+            return chr(value & 0xff)
+        return ('%' + flags + kind.replace('u', 'd')) % value
+
+    return SPEC_RE.sub(conv, fmt)
+
+
+def decode_line(line, messages):
+    if not line.startswith("@L "):
+        return line
+    try:
+        fields = [int(x, 16) for x in line[3:].split()]
+        timestamp, level, msg_id, nargs = fields[:4]
+        words = fields[4:]
+    except ValueError:
+        return line
+
+    string_arg = ""
+    if nargs & FLAG_STRING:
+        raw = b"".join(struct.pack("<I", w) for w in words)
+        string_arg = raw.split(b"\0", 1)[0].decode("utf-8", "replace")
+        words = []
+
+    if msg_id < len(messages):
+        name, fmt = messages[msg_id]
+        text = format_message(fmt, words, string_arg)
+    else:
+        text = "unknown message %d %s" % (msg_id, " ".join("%x" % w for w in words))
+
+    return "[%10.6f] %s %s" % (timestamp / 1e6, LEVELS.get(level, "?"), text)
+
+
+def main():
+    default_msgs = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "applog_msgs.h")
+
+    parser = argparse.ArgumentParser(description="Decode applog records")
+    parser.add_argument("capture", nargs="?", help="serial capture file, stdin if omitted")
+    parser.add_argument("-m", "--messages", default=default_msgs, help="path of applog_msgs.h")
+    parser.add_argument("-p", "--port", help="read from serial port (requires pyserial)")
+    parser.add_argument("-b", "--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    messages = load_messages(args.messages)
+
+    if args.port:
+        import serial
+        stream = (l.decode("utf-8", "replace") for l in serial.Serial(args.port, args.baud))
+    elif args.capture:
+        stream = open(args.capture, errors="replace")
+    else:
+        stream = sys.stdin
+
+    for line in stream:
+        print(decode_line(line.rstrip("\r\n"), messages), flush=True)
+
+
+if __name__ == "__main__":
+    main()